@@ -1,4 +1,5 @@
 #include <SFML/Graphics.hpp>
+#include <SFML/Network.hpp>
 #include <iostream>
 #include <vector>
 #include <chrono>
@@ -7,19 +8,181 @@
 #include <sstream>
 #include <iomanip>
 #include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <unordered_map>
+#include <functional>
+#include <memory>
+#include <new>
+#include <algorithm>
+#include <cstdlib>
+#include <cstdio>
+#include <string>
+#include <cstring>
+#include <array>
+#include <cstdint>
+#include <fstream>
+#include <filesystem>
 
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define FRACTAL_X86_SIMD 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#else
+#define FRACTAL_X86_SIMD 0
+#endif
+
+// Size of the window at startup; it can be resized from there.
 constexpr int WINDOW_WIDTH = 192 * 7;
 constexpr int WINDOW_HEIGHT = 108 * 7;
 constexpr char WINDOW_TITLE[] = "Fractal Renderer";
+// Interaction aims at this frame rate: the window is capped at it, and the
+// first progressive pass is sized to fit in one frame.
+constexpr int TARGET_FPS = 60;
 
 constexpr double ESCAPE_RADIUS_SQUARED = 100.0 * 100.0;
+// Aspect ratio of the startup window, and of views that don't set their own.
 constexpr double ASPECT_RATIO = static_cast<double>(WINDOW_WIDTH) / WINDOW_HEIGHT;
 
 const int NUM_THREADS = std::thread::hardware_concurrency() > 0 ? std::thread::hardware_concurrency() : 8;
-constexpr int PREVIEW_DOWNSCALE = 2;
-constexpr float SCROLL_RENDER_DELAY = 0.1f;
+// Progressive jobs sample every 16th pixel each way first and halve the
+// spacing on every pass down to full resolution. Once the renderer has
+// measured its iteration rate, the first spacing is the finest that fits
+// the frame budget, up to PROGRESSIVE_MAX_DOWNSCALE.
+constexpr int PROGRESSIVE_FIRST_DOWNSCALE = 16;
+constexpr int PROGRESSIVE_MAX_DOWNSCALE = 32;
 constexpr int SCREENSHOT_SCALE = 10;
+// Scale of the DeepZoom pyramid export, for gigapixel posters in web viewers.
+constexpr int PYRAMID_SCALE = 40;
+// Exports render this many rows at a time and never hold more of the image.
+constexpr int RENDER_TILE_SIZE = 64;
+constexpr int EXPORT_BAND_HEIGHT = RENDER_TILE_SIZE;
+constexpr int PYRAMID_TILE_SIZE = 256;
+// The on-disk tile cache, overridden by FRACTAL_TILE_CACHE (a path, or off)
+// and FRACTAL_TILE_CACHE_MB.
+constexpr char DEFAULT_TILE_CACHE_PATH[] = "fractalExplorer.tiles";
+constexpr long long DEFAULT_TILE_CACHE_MEGABYTES = 512;
+// Views whose origins differ by less than 1/TILE_CACHE_PHASE_STEPS of a
+// pixel share their cached tiles.
+constexpr long long TILE_CACHE_PHASE_STEPS = 1 << 16;
+// Distributed exports send workers bands this high, up to
+// WORKER_BANDS_IN_FLIGHT each so none idles while a band is on the wire.
+constexpr int DISTRIBUTED_BAND_HEIGHT = 2 * EXPORT_BAND_HEIGHT;
+constexpr int WORKER_BANDS_IN_FLIGHT = 2;
+constexpr int DEFAULT_WORKER_PORT = 47810;
+// A worker with bands in flight that sends nothing for this long is dropped.
+constexpr int WORKER_TIMEOUT_SECONDS = 600;
+// Zoom videos render key images at this multiple of the frame size and
+// resample the frames in between from them.
+constexpr int ANIMATION_KEY_SCALE = 2;
+// The animated Julia seed goes round a circle of this radius once in this
+// many seconds, through the dendrites and spirals near the Mandelbrot set's edge.
+constexpr double JULIA_PATH_RADIUS = 0.7885;
+constexpr double JULIA_PATH_SECONDS = 20;
+// Seed animation frames are rendered at a multiple of 1/ANIMATION_SCALE_STEPS
+// of the window's size along each side, in at most this share of a frame at
+// TARGET_FPS; the rest goes to the upload and the draw.
+constexpr int ANIMATION_SCALE_STEPS = 16;
+constexpr double ANIMATION_BUDGET_SHARE = 0.75;
+// Anti-aliasing supersamples a pixel when a neighbour's color differs from
+// its own by more than this in some channel, or only one of them is interior.
+constexpr int ANTI_ALIASING_THRESHOLD = 24;
+constexpr int MAX_ANTI_ALIASING_SAMPLES = 8;
+// Palettes are expanded into this many interpolated colors per palette
+// entry, so coloring a pixel is one table lookup.
+constexpr int COLOR_LUT_STEPS = 256;
+// Histogram coloring runs through the palette this many times per unit of
+// colorDensity from the first escaped pixel to the last.
+constexpr double HISTOGRAM_PALETTE_CYCLES = 5;
+// Exports take their histogram from a sample grid about this many pixels
+// along the longer side of the image.
+constexpr int HISTOGRAM_SAMPLE_SIZE = 512;
+// Orbits that come back this close (squared) to a saved point are taken as periodic.
+constexpr double PERIODICITY_TOLERANCE_SQUARED = 1e-28;
+// Iteration at which the periodicity check saves its first orbit point, and
+// how often it compares against it. A cycle whose period doesn't divide the
+// interval is still caught once the saved points are far enough apart.
+constexpr int PERIODICITY_FIRST_CHECK = 8;
+constexpr int PERIODICITY_CHECK_INTERVAL = 4;
+// Below this viewport height (relative to the center's magnitude) neighbouring
+// pixels are too few ulps apart for double, and frames switch to perturbation.
+constexpr double PERTURBATION_VIEWPORT_HEIGHT = 1e-10;
+// Above this pixel size (relative to the center's magnitude) neighbouring
+// pixels are still ~80 float ulps apart, and rows run on the float kernels.
+constexpr double FLOAT_PIXEL_SIZE = 1e-5;
+// Float lanes count iterations in float too, which stops going up at 2^24,
+// so limits from there on stay on double.
+constexpr int FLOAT_MAX_ITERATIONS = 1 << 24;
+// Deepest zoom allowed: pixel deltas are plain doubles and must stay normal.
+constexpr double MIN_VIEWPORT_HEIGHT = 1e-280;
+// Shallowest zoom allowed, far out past the whole set.
+constexpr double MAX_VIEWPORT_HEIGHT = 1e4;
+// View centers and Julia seeds stay this close to the origin, well inside
+// HighPrecision's signed 32-bit integer limb, so sums of them fit it too.
+constexpr double MAX_PLANE_COORDINATE = 1e6;
+// One 32-bit integer limb plus enough fractional limbs for MIN_VIEWPORT_HEIGHT.
+constexpr int HIGH_PRECISION_LIMBS = 34;
+// A bilinear approximation step is used only while the dropped d^2 term stays
+// this small relative to the linear term, i.e. below double rounding.
+constexpr double APPROXIMATION_EPSILON = 1.0 / (1ull << 53);
 
+// Signed fixed-point number for the deep-zoom reference orbit: little-endian
+// 32-bit limbs in two's complement, the top limb holding the integer part.
+// Only the top `fractionLimbs` fractional limbs take part in a multiply, so
+// shallower frames pay for less precision.
+struct HighPrecision {
+    std::array<uint32_t, HIGH_PRECISION_LIMBS> limbs{};
+
+    HighPrecision() = default;
+    // Exact for every double of magnitude below 2^31; larger ones do not fit.
+    explicit HighPrecision(double value);
+
+    double toDouble() const;
+    bool isNegative() const { return (limbs.back() & 0x80000000u) != 0; }
+
+    HighPrecision operator-() const;
+    HighPrecision operator+(const HighPrecision& other) const;
+    HighPrecision operator-(const HighPrecision& other) const { return *this + -other; }
+    bool operator==(const HighPrecision& other) const { return limbs == other.limbs; }
+    bool operator!=(const HighPrecision& other) const { return limbs != other.limbs; }
+};
+
+HighPrecision multiply(const HighPrecision& a, const HighPrecision& b, int fractionLimbs);
+// Decimal text, e.g. "-0.743643887037158704752191506114774". Parsing accepts
+// [-]digits[.digits] exactly up to the precision of the limbs; formatting
+// rounds to `fractionDigits` digits.
+bool parseHighPrecision(const std::string& text, HighPrecision& value);
+std::string formatHighPrecision(const HighPrecision& value, int fractionDigits);
+
+// How the rectangle-subdivision fill treats a rectangle whose border pixels
+// all share one result.
+enum class SolidFill {
+    // Iterates every pixel.
+    Off,
+    // Fills rectangles bordered only by points that never escaped. Those are
+    // black in every coloring mode, so only detail too thin for the border
+    // samples to catch can be lost.
+    Interior,
+    // Also fills rectangles whose border escaped at one iteration count and
+    // interpolates the smooth and stripe values inside from the border, which
+    // makes smooth and stripe coloring there approximate.
+    Bands
+};
 
 struct RenderState {
     double viewportX = -0.5;
@@ -38,22 +201,976 @@ struct RenderState {
     float stripeIntensity = 10;
     bool innerCalculation = false;
     bool antiAliasing = false;
+    // Samples per side of an anti-aliased edge pixel, up to MAX_ANTI_ALIASING_SAMPLES.
+    int antiAliasingSamples = 3;
+    SolidFill solidFill = SolidFill::Off;
+    // Spreads the palette over the escaped pixels by their share of the
+    // image rather than by iteration count. Stripe coloring ignores it.
+    bool histogramColoring = false;
+    // The part of the view center below the precision of viewportX/Y, so deep
+    // zooms keep their position. Moves go through moveView.
+    HighPrecision viewportXLow;
+    HighPrecision viewportYLow;
+    // Width over height of the images the view is rendered to; the window
+    // sets it from its size.
+    double aspectRatio = ASPECT_RATIO;
 
     double getViewportWidth() const {
-        return viewportHeight * ASPECT_RATIO;
+        return viewportHeight * aspectRatio;
     }
 };
 
+HighPrecision getCenterX(const RenderState& state) {
+    return HighPrecision(state.viewportX) + state.viewportXLow;
+}
+
+HighPrecision getCenterY(const RenderState& state) {
+    return HighPrecision(state.viewportY) + state.viewportYLow;
+}
+
+void setViewCenter(RenderState& state, const HighPrecision& centerX, const HighPrecision& centerY) {
+    state.viewportX = centerX.toDouble();
+    state.viewportY = centerY.toDouble();
+    state.viewportXLow = centerX - HighPrecision(state.viewportX);
+    state.viewportYLow = centerY - HighPrecision(state.viewportY);
+}
+
+// Moves the view center by (deltaX, deltaY) at full precision. It stops at
+// MAX_PLANE_COORDINATE.
+void moveView(RenderState& state, double deltaX, double deltaY) {
+    if (std::fabs(state.viewportX + deltaX) > MAX_PLANE_COORDINATE) {
+        deltaX = std::copysign(MAX_PLANE_COORDINATE, state.viewportX + deltaX) - state.viewportX;
+    }
+    if (std::fabs(state.viewportY + deltaY) > MAX_PLANE_COORDINATE) {
+        deltaY = std::copysign(MAX_PLANE_COORDINATE, state.viewportY + deltaY) - state.viewportY;
+    }
+    setViewCenter(state, getCenterX(state) + HighPrecision(deltaX), getCenterY(state) + HighPrecision(deltaY));
+}
+
+// Decimal places that pin the view center well below a pixel.
+int getPositionDigits(const RenderState& state) {
+    int digits = static_cast<int>(std::ceil(-std::log10(state.viewportHeight))) + 8;
+    return std::clamp(digits, 17, 330);
+}
+
+bool usesPerturbation(const RenderState& state) {
+    double magnitude = std::max(1.0, std::max(std::fabs(state.viewportX), std::fabs(state.viewportY)));
+    return state.viewportHeight < PERTURBATION_VIEWPORT_HEIGHT * magnitude;
+}
+
 struct ReturnInfo {
     int iteration;
     double smoothIteration;
-    double stripeSum;
+    // Mean of sin^2(stripeFrequency * arg z) over the orbit; see getStripeAverage.
+    double stripeAverage;
+};
+
+// How a kernel left a pixel's orbit. Only the interactive frame keeps these:
+// when maxIterations goes up, pixels that reached the old limit carry on from
+// where they stopped instead of starting over.
+enum class OrbitEnd : sf::Uint8 {
+    // Escaped, or shown to be interior (cardioid, bulb, periodicity): the
+    // result holds under any higher limit.
+    Final,
+    // Reached the limit, and a higher one starts it over: the kernel had no
+    // orbit to hand back (perturbation), or the result was filled in.
+    Limit,
+    // Reached the limit with the orbit saved.
+    Saved
+};
+
+// For OrbitEnd::Limit and Saved, `iteration` is the limit the orbit got to;
+// Saved orbits also keep their last point. The stripe sum is not kept: a
+// pixel that reached the limit has the plain average as its stripeAverage,
+// which gives the sum back.
+struct OrbitState {
+    OrbitEnd end;
+    int iteration;
+    double zr;
+    double zi;
+};
+
+#ifdef FRACTAL_COUNT_ALLOCATIONS
+// Builds with FRACTAL_COUNT_ALLOCATIONS count every heap allocation of the
+// process, so the benchmark can check that warmed-up render jobs make none.
+// Every other build keeps the standard operators and their cost. The
+// replacements stay out of line, so no caller sees new paired with free.
+#ifdef _MSC_VER
+#define FRACTAL_NOINLINE __declspec(noinline)
+#else
+#define FRACTAL_NOINLINE __attribute__((noinline))
+#endif
+
+std::atomic<long long> heapAllocations{ 0 };
+
+FRACTAL_NOINLINE void* operator new(std::size_t size) {
+    heapAllocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* block = std::malloc(size > 0 ? size : 1)) return block;
+    throw std::bad_alloc();
+}
+
+FRACTAL_NOINLINE void* operator new(std::size_t size, std::align_val_t alignment) {
+    heapAllocations.fetch_add(1, std::memory_order_relaxed);
+    size_t bytes = static_cast<size_t>(alignment);
+#ifdef _WIN32
+    void* block = _aligned_malloc(size > 0 ? size : 1, bytes);
+#else
+    // aligned_alloc wants a multiple of the alignment.
+    void* block = std::aligned_alloc(bytes, (std::max<size_t>(size, 1) + bytes - 1) / bytes * bytes);
+#endif
+    if (block) return block;
+    throw std::bad_alloc();
+}
+
+FRACTAL_NOINLINE void operator delete(void* block) noexcept {
+    std::free(block);
+}
+
+FRACTAL_NOINLINE void operator delete(void* block, std::align_val_t) noexcept {
+#ifdef _WIN32
+    _aligned_free(block);
+#else
+    std::free(block);
+#endif
+}
+
+// The sized forms free like the unsized ones.
+FRACTAL_NOINLINE void operator delete(void* block, std::size_t) noexcept {
+    ::operator delete(block);
+}
+
+FRACTAL_NOINLINE void operator delete(void* block, std::size_t, std::align_val_t alignment) noexcept {
+    ::operator delete(block, alignment);
+}
+
+long long getHeapAllocations() {
+    return heapAllocations.load();
+}
+#else
+// Without FRACTAL_COUNT_ALLOCATIONS nothing is counted.
+long long getHeapAllocations() {
+    return -1;
+}
+#endif
+
+constexpr size_t CACHE_LINE_SIZE = 64;
+
+// Hands out storage starting on a cache line, so planes cut into tiles at
+// multiples of the line size never share a line between two tiles.
+template <typename T>
+struct CacheLineAllocator {
+    using value_type = T;
+
+    CacheLineAllocator() = default;
+    template <typename U>
+    CacheLineAllocator(const CacheLineAllocator<U>&) {
+    }
+
+    T* allocate(size_t count) {
+        return static_cast<T*>(::operator new(count * sizeof(T), std::align_val_t(CACHE_LINE_SIZE)));
+    }
+    void deallocate(T* pointer, size_t) {
+        ::operator delete(pointer, std::align_val_t(CACHE_LINE_SIZE));
+    }
+
+    template <typename U>
+    bool operator==(const CacheLineAllocator<U>&) const { return true; }
+    template <typename U>
+    bool operator!=(const CacheLineAllocator<U>&) const { return false; }
+};
+
+template <typename T>
+using CacheLineVector = std::vector<T, CacheLineAllocator<T>>;
+
+// Escape-time results as a structure of arrays: coloring streams through the
+// iteration counts and one of the two values, and never loads the third.
+struct ResultPlanes {
+    explicit ResultPlanes(size_t size = 0)
+        : iterations(size), smoothIterations(size), stripeAverages(size) {
+    }
+
+    size_t size() const { return iterations.size(); }
+    void resize(size_t size) {
+        iterations.resize(size);
+        smoothIterations.resize(size);
+        stripeAverages.resize(size);
+    }
+    ReturnInfo get(size_t index) const {
+        return { iterations[index], smoothIterations[index], stripeAverages[index] };
+    }
+    void set(size_t index, const ReturnInfo& info) {
+        iterations[index] = info.iteration;
+        smoothIterations[index] = info.smoothIteration;
+        stripeAverages[index] = info.stripeAverage;
+    }
+    void swap(ResultPlanes& other) {
+        iterations.swap(other.iterations);
+        smoothIterations.swap(other.smoothIterations);
+        stripeAverages.swap(other.stripeAverages);
+    }
+
+    CacheLineVector<int> iterations;
+    CacheLineVector<double> smoothIterations;
+    CacheLineVector<double> stripeAverages;
+};
+
+// OrbitState as a structure of arrays, alongside the ResultPlanes it belongs to.
+struct OrbitPlanes {
+    explicit OrbitPlanes(size_t size = 0)
+        : ends(size, OrbitEnd::Limit), iterations(size), zr(size), zi(size) {
+    }
+
+    void resize(size_t size) {
+        ends.resize(size, OrbitEnd::Limit);
+        iterations.resize(size);
+        zr.resize(size);
+        zi.resize(size);
+    }
+    OrbitState get(size_t index) const {
+        return { ends[index], iterations[index], zr[index], zi[index] };
+    }
+    void set(size_t index, const OrbitState& orbit) {
+        ends[index] = orbit.end;
+        iterations[index] = orbit.iteration;
+        zr[index] = orbit.zr;
+        zi[index] = orbit.zi;
+    }
+    void swap(OrbitPlanes& other) {
+        ends.swap(other.ends);
+        iterations.swap(other.iterations);
+        zr.swap(other.zr);
+        zi.swap(other.zi);
+    }
+
+    CacheLineVector<OrbitEnd> ends;
+    CacheLineVector<int> iterations;
+    CacheLineVector<double> zr;
+    CacheLineVector<double> zi;
+};
+
+// What the kernels did beyond plain iteration, summed per worker and per job.
+// Padded so workers counting side by side don't share a cache line.
+struct alignas(64) KernelCounters {
+    // Pixels reported as interior because their orbit turned periodic.
+    long long periodicityExits = 0;
+    // Times a perturbation orbit was moved back to the start of the reference.
+    long long rebases = 0;
+    // Iterations a perturbation orbit jumped over with a bilinear approximation.
+    long long skippedIterations = 0;
+    // Escape-time iterations the finished pixels stand for, interior ones at
+    // the full limit, whatever shortcuts produced them. Only the one-shot
+    // renders count these; they are what the benchmark's Giter/s divides.
+    long long iterations = 0;
+    // Iterations the kernels actually stepped through, per pixel and sample;
+    // a bilinear approximation step counts as one.
+    long long executedIterations = 0;
+    // Pixels the cardioid and period-2 bulb tests sent straight to the interior.
+    long long cardioidSkips = 0;
+    // Pixels the rectangle-subdivision fill set without iterating them.
+    long long filledPixels = 0;
+    // Pixels the tile cache brought back from an earlier render.
+    long long cachedPixels = 0;
+
+    void add(const KernelCounters& other) {
+        periodicityExits += other.periodicityExits;
+        rebases += other.rebases;
+        skippedIterations += other.skippedIterations;
+        iterations += other.iterations;
+        executedIterations += other.executedIterations;
+        cardioidSkips += other.cardioidSkips;
+        filledPixels += other.filledPixels;
+        cachedPixels += other.cachedPixels;
+    }
+};
+
+struct RenderTile {
+    int startX;
+    int startY;
+    int endX;
+    int endY;
+};
+
+// Long-lived worker pool shared by every render path. Each batch of tiles is
+// dealt round-robin into per-worker deques; a worker drains its own deque from
+// the front and, once empty, steals from the back of the others, so tiles that
+// cross the set's interior don't leave the remaining cores idle.
+class RenderThreadPool {
+public:
+    using TileFunction = std::function<void(const RenderTile& tile, int threadIndex)>;
+
+    explicit RenderThreadPool(int threadCount);
+    ~RenderThreadPool();
+
+    RenderThreadPool(const RenderThreadPool&) = delete;
+    RenderThreadPool& operator=(const RenderThreadPool&) = delete;
+
+    // Queues a batch and returns immediately; any batch still running is waited for first.
+    void submit(const std::vector<RenderTile>& tiles, TileFunction function);
+    // Drops every tile that hasn't started yet. Tiles already running finish normally.
+    void cancel();
+    void wait();
+    bool isIdle();
+
+    // Blocks until every tile has been processed.
+    void run(const std::vector<RenderTile>& tiles, const TileFunction& function);
+
+    int getThreadCount() const { return static_cast<int>(workers.size()); }
+
+    // Milliseconds each worker spent inside tile functions during the last
+    // completed batch, written over `times`.
+    void getBusyTimes(std::vector<double>& times);
+    // The largest of them: workers run side by side, so about the batch's time.
+    double getLongestBusyTime();
+
+private:
+    struct Worker {
+        std::thread thread;
+        std::mutex queueMutex;
+        // Tiles [queueFront, size) are left; the owner takes the front and
+        // thieves the back. The storage is kept from batch to batch, so
+        // submitting allocates nothing once a batch that large was seen.
+        std::vector<RenderTile> queue;
+        size_t queueFront = 0;
+        double busyTime = 0;
+    };
+
+    void workerLoop(int index);
+    bool popTile(int index, RenderTile& tile);
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::vector<double> busyTimes;
+
+    std::mutex poolMutex;
+    std::condition_variable workAvailable;
+    std::condition_variable workFinished;
+    TileFunction currentFunction;
+    unsigned long long batchId = 0;
+    int finishedWorkers = 0;
+    bool stopping = false;
+};
+
+std::vector<RenderTile> makeTiles(int width, int height, int tileSize);
+// Refills `tiles` in place, keeping its storage.
+void makeTiles(int width, int height, int tileSize, std::vector<RenderTile>& tiles);
+struct FractalKernels;
+struct ReferenceOrbit;
+struct AntiAliasingScratch;
+class Coloring;
+// `pixels` holds the rows of the image from `firstRow` on.
+void renderFractalRegion(sf::Uint8* pixels, int firstRow, const RenderState& state, const Coloring& coloring,
+    const FractalKernels& kernels, const RenderTile& tile, int width, int height, AntiAliasingScratch& scratch,
+    KernelCounters& counters);
+
+// The interactive frame: RGBA for the texture plus the per-pixel escape-time
+// results it was colored from. `computed` marks the pixels whose result
+// belongs to the current view; everything else is pending and gets iterated
+// by the next render job. `refined` marks the pixels whose color is
+// an anti-aliased average rather than the color of their result. `orbits`
+// says how each result's orbit ended; a pending pixel with a saved orbit
+// carries on from it, every other pending pixel starts over.
+//
+// Every plane is stored tile by tile on the RENDER_TILE_SIZE grid render
+// jobs use, each tile row by row and starting on a cache line, so a worker
+// only ever touches its own tile's lines and a finished tile goes to the
+// texture straight from the plane.
+struct FrameBuffer {
+    FrameBuffer(int width, int height)
+        : width(width), height(height), pixels(width * height * 4), results(width * height),
+        orbits(width * height), computed(width * height, 0), refined(width * height, 0) {
+    }
+
+    // Where pixel (x, y) lives in the planes. Pixels of one tile row follow
+    // each other, so a run inside one tile starts at index(startX, y).
+    int index(int x, int y) const {
+        int tileLeft = x / RENDER_TILE_SIZE * RENDER_TILE_SIZE;
+        int tileTop = y / RENDER_TILE_SIZE * RENDER_TILE_SIZE;
+        return tileTop * width + tileLeft * getTileHeight(y) + (y - tileTop) * getTileWidth(x) + (x - tileLeft);
+    }
+    // Size of the tile holding column `x` or row `y`; only the last tiles
+    // across and down may be cut short.
+    int getTileWidth(int x) const {
+        return std::min(RENDER_TILE_SIZE, width - x / RENDER_TILE_SIZE * RENDER_TILE_SIZE);
+    }
+    int getTileHeight(int y) const {
+        return std::min(RENDER_TILE_SIZE, height - y / RENDER_TILE_SIZE * RENDER_TILE_SIZE);
+    }
+
+    void invalidate();
+    void clearRefined();
+    // Moves the content so pixel (x, y) now holds what (x + offsetX, y + offsetY)
+    // held before. Uncovered pixels turn black and pending.
+    void shift(int offsetX, int offsetY);
+    // Rebuilds the frame for a view whose pixel (x, y) sits at old pixel
+    // ((baseX + x * step) / divisor, (baseY + y * step) / divisor). Pixels that
+    // land exactly on an old sample keep its result; the rest turn pending and
+    // show the nearest old pixel, or black outside the old view. No pixel
+    // stays refined, since its samples covered an old pixel.
+    void rescale(int baseX, int baseY, int step, int divisor);
+    // Turns pending every result a change of maxIterations to `limit` could
+    // alter. Pixels that escaped below it or were shown interior stay
+    // computed, and so do pixels that reached as high a limit without
+    // escaping, unless the inner calculation needs their orbit at `limit`.
+    void applyLimit(int limit);
+    bool isComplete() const;
+    // The rows of `tile`, one tile of the grid, in which some pixel of
+    // `plane` holds `value`, across the whole tile; empty when there are none.
+    RenderTile findRows(const CacheLineVector<sf::Uint8>& plane, sf::Uint8 value, const RenderTile& tile) const;
+
+    int width;
+    int height;
+    CacheLineVector<sf::Uint8> pixels;
+    ResultPlanes results;
+    OrbitPlanes orbits;
+    CacheLineVector<sf::Uint8> computed;
+    CacheLineVector<sf::Uint8> refined;
+    // A pixel on the coarse passes' grids, kept on the samples that survived
+    // the last zoom so the first passes right after it iterate nothing.
+    int gridOriginX = 0;
+    int gridOriginY = 0;
+
+private:
+    CacheLineVector<sf::Uint8> scratchPixels;
+    ResultPlanes scratchResults;
+    OrbitPlanes scratchOrbits;
+    CacheLineVector<sf::Uint8> scratchComputed;
+};
+
+// Escape-time results of interactive frames, kept on disk across sessions
+// so views seen before come back without iterating. For every pixel size the
+// complex plane gets a lattice of pixels, shifted by the sub-pixel phase of
+// the view, and results are cached per RENDER_TILE_SIZE square of it; views
+// a drag, a bookmark or a reset lead back to share their tiles, which fill
+// up pixel by pixel as frames cover them. Tiles are addressed by everything
+// their results depend on. The file is mapped into
+// memory as a fixed number of slots, and once all are taken the least
+// recently used tile makes room. Perturbation views are left out, since their
+// positions outgrow a double lattice.
+class TileCache {
+public:
+    TileCache() = default;
+    TileCache(const TileCache&) = delete;
+    TileCache& operator=(const TileCache&) = delete;
+    ~TileCache();
+
+    // Maps the cache at `path`, keeping its tiles when the file already holds
+    // `capacityBytes` worth of slots of this layout and starting over
+    // otherwise. Returns false when the file can't be mapped.
+    bool open(const std::string& path, long long capacityBytes);
+    // Fills the pending pixels of `tile`, in a frame showing `state`, from the
+    // cached tiles and colors them. Returns how many pixels it filled.
+    int fill(FrameBuffer& frame, const RenderState& state, const Coloring& coloring, const RenderTile& tile);
+    // Adds the computed pixels of a frame showing `state` to their tiles.
+    // Returns how many new pixels it stored.
+    int store(const FrameBuffer& frame, const RenderState& state);
+
+private:
+    // Fields are all eight bytes wide so keys compare and hash as plain bytes.
+    struct TileKey {
+        int64_t fractalType;
+        int64_t flags;
+        int64_t maxIterations;
+        int64_t solidFill;
+        int64_t precision;
+        double stripeFrequency;
+        double juliaX;
+        double juliaY;
+        double pixelWidth;
+        double pixelHeight;
+        int64_t phaseX;
+        int64_t phaseY;
+        int64_t tileX;
+        int64_t tileY;
+    };
+    struct TileKeyHash {
+        size_t operator()(const TileKey& key) const;
+    };
+    struct TileKeyEqual {
+        bool operator()(const TileKey& a, const TileKey& b) const {
+            return std::memcmp(&a, &b, sizeof(TileKey)) == 0;
+        }
+    };
+    struct FileHeader {
+        char magic[8];
+        uint64_t tileSize;
+        uint64_t resultSize;
+        uint64_t slotCount;
+    };
+    // A slot is this header, a byte per pixel marking the ones cached, and
+    // their results. `used` is set last, so a slot torn by a crash while it
+    // was taken reads as free.
+    struct SlotHeader {
+        TileKey key;
+        uint64_t lastUse;
+        uint64_t cachedPixels;
+        uint64_t used;
+    };
+    // The lattice of a frame: the key of its tiles at tile (0, 0), and the
+    // lattice pixel frame pixel (0, 0) sits on.
+    struct FrameGrid {
+        TileKey key;
+        int64_t originX;
+        int64_t originY;
+    };
+
+    static bool getGrid(const RenderState& state, int width, int height, FrameGrid& grid);
+    SlotHeader& getSlot(size_t slot);
+    sf::Uint8* getSlotMask(size_t slot);
+    ReturnInfo* getSlotData(size_t slot);
+    // A free slot, or the least recently used one after dropping its tile.
+    size_t takeSlot();
+    void close();
+
+    std::mutex mutex;
+    unsigned char* mapping = nullptr;
+    size_t mappingSize = 0;
+    size_t slotSize = 0;
+    size_t slotCount = 0;
+    uint64_t useCounter = 0;
+    std::unordered_map<TileKey, size_t, TileKeyHash, TileKeyEqual> slots;
+    std::vector<size_t> freeSlots;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE fileMapping = nullptr;
+#else
+    int file = -1;
+#endif
+};
+
+// A palette expanded into COLOR_LUT_STEPS interpolated colors per entry,
+// built once per palette; the last entry blends back into the first.
+struct ColorLut {
+    explicit ColorLut(const std::vector<sf::Color>& palette);
+
+    std::vector<sf::Color> colors;
+};
+
+// Whether `state` colors by the histogram of its escaped pixels.
+bool usesHistogramColoring(const RenderState& state);
+
+// How the results of one render turn into colors: the lookup table of the
+// palette and the scale of the value that indexes it, which folds in
+// colorDensity, plus with histogram coloring the share of escaped pixels
+// below each iteration count. Every color path goes through one, so the
+// coarse passes, the final pass and anti-aliasing agree.
+class Coloring {
+public:
+    // Without an `equalization`, or one for another iteration limit, the
+    // palette follows the iteration count even with histogram coloring on.
+    explicit Coloring(const RenderState& state, std::shared_ptr<const std::vector<float>> equalization = nullptr);
+
+    sf::Color getColor(const ReturnInfo& info) const;
+    // Colors `count` consecutive results from `first` on into RGBA at `rgba`,
+    // skipping the pixels `skip` marks; it may be null.
+    void colorize(const ResultPlanes& results, int first, int count, sf::Uint8* rgba, const sf::Uint8* skip) const;
+
+private:
+    // The table entry of palette position `position`, wrapped around the palette.
+    int getIndex(double position) const {
+        double wrapped = position - period * std::floor(position * inversePeriod);
+        return std::max(0, std::min(static_cast<int>(wrapped * COLOR_LUT_STEPS), lastIndex));
+    }
+    double getEqualizedPosition(double smoothIteration) const;
+
+    const ColorLut* lut;
+    bool stripes;
+    double scale;
+    double period;
+    double inversePeriod;
+    int lastIndex;
+    std::shared_ptr<const std::vector<float>> equalization;
+};
+
+// Counts escaped pixels per whole smooth iteration count, one set of counts
+// per worker so filling it takes no locks.
+class IterationHistogram {
+public:
+    void reset(int threadCount, int maxIterations);
+    void add(int threadIndex, int iteration, double smoothIteration) {
+        if (iteration == -1) return;
+        int bin = std::max(0, std::min(static_cast<int>(smoothIteration), bins - 1));
+        counts[threadIndex][bin]++;
+    }
+    // Merges the workers' counts into the share of counted pixels below each
+    // bin, with one more entry for the end. The shares are written over the
+    // ones returned last time if nobody holds those any more.
+    std::shared_ptr<const std::vector<float>> getEqualization();
+
+private:
+    int bins = 0;
+    std::vector<std::vector<long long>> counts;
+    std::vector<long long> total;
+    std::shared_ptr<std::vector<float>> shares;
+};
+
+// Whether full renders of `state` go through the rectangle-subdivision fill.
+bool usesSolidFill(const RenderState& state);
+// The region functions below work on a `tile` inside one tile of the frame.
+// Unless `recolorAll` is set, pixels computed earlier keep their current color.
+void renderPendingRegion(FrameBuffer& frame, const RenderState& state, const Coloring& coloring,
+    const FractalKernels& kernels, const RenderTile& tile, bool recolorAll, KernelCounters& counters);
+// Iterates the pending pixels on the grid with `downscale` spacing and fills
+// every pending pixel from the sample of its grid cell.
+void renderCoarsePass(FrameBuffer& frame, const RenderState& state, const Coloring& coloring,
+    const FractalKernels& kernels, const RenderTile& tile, int downscale, bool recolorAll, KernelCounters& counters);
+// Refined pixels keep their anti-aliased color.
+void colorizeRegion(FrameBuffer& frame, const Coloring& coloring, const RenderTile& tile);
+
+// Per-thread buffers for anti-aliasing one tile, allocated once up front.
+// Results and colors cover the tile plus a one-pixel ring around it.
+struct AntiAliasingScratch {
+    AntiAliasingScratch();
+
+    ResultPlanes centers;
+    std::vector<sf::Color> colors;
+    std::vector<sf::Uint8> computed;
+    std::vector<int> edgeColumns;
+    std::vector<int> sampleColumns;
+    std::vector<ReturnInfo> samples;
+    std::vector<int> sums;
+};
+
+// `tile` grown by `margin` pixels on every side, clipped to the image.
+RenderTile expandTile(const RenderTile& tile, int margin, int width, int height);
+// Supersamples the pixels of `tile` that differ from a neighbour. The results
+// of `area` (expandTile(tile, 1, ...)) are in `scratch.centers`, row by row.
+// Pixel (x, y) of the tile is at (y - tile.startY) * stride + x - tile.startX
+// in `pixels` and `refined`. Pixels marked in `refined` are skipped, and
+// refined pixels get marked; it may be null.
+void refineEdges(sf::Uint8* pixels, int stride, sf::Uint8* refined, const RenderState& state,
+    const Coloring& coloring, const FractalKernels& kernels, const RenderTile& tile, const RenderTile& area,
+    int width, int height, AntiAliasingScratch& scratch, KernelCounters& counters);
+
+// Where the time of a render job went, for one tile of the frame's grid or
+// for one worker, summed over the job's passes.
+struct RenderStats {
+    double milliseconds = 0;
+    // Tile passes run.
+    int tiles = 0;
+    KernelCounters counters;
+
+    void add(double passMilliseconds, const KernelCounters& passCounters) {
+        milliseconds += passMilliseconds;
+        tiles++;
+        counters.add(passCounters);
+    }
+};
+
+enum class RenderMode {
+    // Iterates every pending pixel at full resolution.
+    Full,
+    // Runs coarse passes from PROGRESSIVE_FIRST_DOWNSCALE down, each one
+    // uploaded as it finishes and reusing the samples of the ones before,
+    // and ends with a full-resolution pass.
+    Progressive,
+    // Maps the stored iteration data through the current palette without iterating.
+    Recolor
+};
+
+// Picks the sample spacing of the first progressive pass: the finest power
+// of two whose pass fits in one frame at TARGET_FPS, predicted from the
+// iteration rate and the iterations per pixel of the progressive jobs
+// before. Rates are per millisecond of wall time, so they cover every core
+// of the pool, and the prediction scales with the frame's pixel count.
+class RenderBudget {
+public:
+    // Books a completed job that iterated a `pixels`-pixel frame.
+    void addJob(const KernelCounters& counters, long long pixels, double milliseconds);
+    int getFirstDownscale(long long pixels) const;
+    // Side of a frame relative to the `pixels`-pixel window, in steps of
+    // 1/ANIMATION_SCALE_STEPS: the largest whose frame fits `budgetMilliseconds`.
+    double getFrameScale(long long pixels, double budgetMilliseconds) const;
+    // Billions of iterations per second, 0 until a job was booked.
+    double getIterationRate() const { return iterationsPerMillisecond / 1e6; }
+
+private:
+    double iterationsPerMillisecond = 0;
+    double iterationsPerPixel = 0;
+};
+
+// What the window draws its views with. main() starts each view on the
+// shader backend when it supports the view and on the CPU one otherwise, and
+// shows the texture of the backend that drew the view last.
+class RenderBackend {
+public:
+    virtual ~RenderBackend() = default;
+
+    virtual bool supports(const RenderState& state) const = 0;
+    // Starts drawing `state`; `mode` says how much of the backend's last view
+    // carries over. Backends that draw whole frames at once ignore it.
+    virtual void start(const RenderState& state, RenderMode mode) = 0;
+    // Stops the view in flight, if any.
+    virtual void cancel() = 0;
+    // Brings finished work to the texture. Returns true, once, when the view
+    // started last is complete.
+    virtual bool present() = 0;
+    virtual const sf::Texture& getTexture() const = 0;
+};
+
+// Runs one render job at a time on the pool without blocking the event loop.
+// A job renders a snapshot of the RenderState tagged with a generation number;
+// starting a new job cancels the one in flight at tile (and row) granularity.
+class AsyncRenderer {
+public:
+    // Without a `cache` every job iterates all its pending pixels.
+    AsyncRenderer(RenderThreadPool& pool, FrameBuffer& frame, TileCache* cache = nullptr);
+    ~AsyncRenderer();
+
+    // Keeps the stored results that are still valid for `state`: all of them
+    // when only the coloring changed, the overlapping part when the view moved
+    // by whole pixels, and the samples that line up with the new pixel grid
+    // after a 2x zoom in or out. A Recolor request falls back to a full render while the
+    // stored data doesn't describe the whole frame.
+    void start(const RenderState& state, RenderMode mode);
+    // Stops the job in flight and waits until no worker touches the pixel buffer.
+    void cancel();
+    // Stops the job in flight and reallocates the frame and everything sized
+    // by it for a `width` x `height` window. The next job starts from scratch.
+    void resize(int width, int height);
+
+    // Pushes the rows that tiles finished since the last call changed to the
+    // texture. Returns true when the job in flight completed during this call.
+    bool uploadFinishedTiles(sf::Texture& texture) { return finishTiles(&texture); }
+    // The same without a texture, for headless runs: finished rows are dropped.
+    bool advance() { return finishTiles(nullptr); }
+
+    bool isBusy() const { return busy; }
+    RenderMode getMode() const { return mode; }
+    unsigned long long getGeneration() const { return generation; }
+    // Milliseconds the last completed job took from start to its final tile,
+    // and to the last tile of its first pass.
+    long long getRenderTime() const { return renderTime; }
+    long long getFirstPassTime() const { return firstPassTime; }
+    // Sample spacing of the first pass of the last progressive job.
+    int getFirstDownscale() const { return firstDownscale; }
+    const RenderBudget& getBudget() const { return budget; }
+    // What the kernels did during the last completed job.
+    const KernelCounters& getCounters() const { return jobCounters; }
+    // The last completed job per tile, row by row across the frame, and per worker.
+    const std::vector<RenderStats>& getTileStats() const { return jobTileStats; }
+    const std::vector<RenderStats>& getWorkerStats() const { return jobWorkerStats; }
+    int getTilesAcross() const { return tilesAcross; }
+    // Pixels the last completed job sent to the texture.
+    long long getUploadedPixels() const { return jobUploadedPixels; }
+
+private:
+    struct FinishedTile {
+        unsigned long long generation;
+        // The rows of a tile its pass changed, across the whole tile, so
+        // they are one contiguous block of the pixel plane.
+        RenderTile rows;
+    };
+
+    enum class Pass {
+        // Iterates the pending pixels at the pass's downscale.
+        Iterate,
+        // Counts the frame's results once they are all in, for histogram coloring.
+        Histogram,
+        // Maps every result through the coloring.
+        Recolor,
+        // Anti-aliases the edges.
+        Refine
+    };
+
+    bool finishTiles(sf::Texture* texture);
+    void submitPass(Pass pass, int downscale);
+    void renderTile(const RenderTile& tile, unsigned long long jobGeneration, int threadIndex, Pass pass,
+        int downscale, bool recolor, bool firstPass);
+    void refineTile(const RenderTile& tile, unsigned long long jobGeneration, int threadIndex);
+    void countTile(const RenderTile& tile, unsigned long long jobGeneration, int threadIndex);
+    void reuseIterationData(const RenderState& state);
+    void updateKernels();
+    // Books one tile pass; every tile and worker belongs to one thread at a time.
+    void recordTile(const RenderTile& tile, int threadIndex, std::chrono::high_resolution_clock::time_point start,
+        const KernelCounters& counters);
+
+    RenderThreadPool& pool;
+    FrameBuffer& frame;
+    TileCache* cache;
+    std::vector<RenderTile> tiles;
+
+    RenderState snapshot;
+    RenderMode mode = RenderMode::Full;
+    // The view the computed pixels of the frame belong to.
+    RenderState dataState;
+    bool hasDataState = false;
+    // Set when the coloring changed since the computed pixels were last colored.
+    bool recolorAll = true;
+    // Set when the frame moved under the texture. The moved frame is copied
+    // to `staging` before the job's workers start and uploaded from there,
+    // so nothing is read from the pixel plane while a worker writes it.
+    bool uploadWholeFrame = false;
+    CacheLineVector<sf::Uint8> staging;
+    long long uploadedPixels = 0;
+    long long jobUploadedPixels = 0;
+    unsigned long long generation = 0;
+    std::atomic<unsigned long long> activeGeneration{ 0 };
+    std::atomic<int> remainingTiles{ 0 };
+    // The pass in flight and the spacing of the samples it iterates.
+    // Histogram-colored jobs recolor the frame once all results are in, and
+    // anti-aliased jobs end with a refining pass, since edge detection looks
+    // across tile borders.
+    Pass pass = Pass::Iterate;
+    int passDownscale = 1;
+    // Whether the pass recolors the pixels computed before the job, and is its first.
+    bool passRecolor = false;
+    bool passFirst = false;
+    // What the passes of the job color with. Histogram-colored passes before
+    // the frame's histogram is in use the one of the frame before, if any.
+    Coloring coloring{ RenderState() };
+    IterationHistogram histogram;
+    std::shared_ptr<const std::vector<float>> equalization;
+    // Set while `equalization` counts the computed pixels of the frame.
+    bool equalizationCurrent = false;
+
+    std::mutex finishedMutex;
+    std::vector<FinishedTile> finishedTiles;
+    std::vector<FinishedTile> drainedTiles;
+
+    int tilesAcross;
+    std::vector<RenderStats> tileStats;
+    std::vector<RenderStats> workerStats;
+    std::vector<RenderStats> jobTileStats;
+    std::vector<RenderStats> jobWorkerStats;
+    KernelCounters jobCounters;
+    std::vector<AntiAliasingScratch> workerScratch;
+
+    // Deep zooms keep the reference orbit until the center or the formula moves.
+    std::unique_ptr<ReferenceOrbit> reference;
+    RenderState referenceState;
+    std::unique_ptr<FractalKernels> kernels;
+
+    RenderBudget budget;
+    int firstDownscale = PROGRESSIVE_FIRST_DOWNSCALE;
+
+    bool busy = false;
+    std::chrono::high_resolution_clock::time_point startTime;
+    long long renderTime = 0;
+    long long firstPassTime = 0;
+    long long pendingFirstPassTime = -1;
+};
+
+// The CPU backend: AsyncRenderer jobs, uploaded tile by tile to `texture`.
+// It supports every view.
+class CpuRenderBackend : public RenderBackend {
+public:
+    CpuRenderBackend(AsyncRenderer& renderer, sf::Texture& texture) : renderer(renderer), texture(texture) {}
+
+    bool supports(const RenderState&) const override { return true; }
+    void start(const RenderState& state, RenderMode mode) override { renderer.start(state, mode); }
+    void cancel() override { renderer.cancel(); }
+    bool present() override { return renderer.uploadFinishedTiles(texture); }
+    const sf::Texture& getTexture() const override { return texture; }
+
+private:
+    AsyncRenderer& renderer;
+    sf::Texture& texture;
+};
+
+// One-shot render of a `width` x `height` image of `state`, a band of rows
+// at a time, so images far larger than memory can be produced piece by
+// piece. The reference orbit of a deep zoom is computed once for all bands,
+// and so is the histogram of histogram coloring, from a coarse sample grid.
+class BandRenderer {
+public:
+    // `preparedReference` may bring an orbit ready for `state`; deep zooms
+    // without one compute their own.
+    BandRenderer(RenderThreadPool& pool, const RenderState& state, int width, int height,
+        std::unique_ptr<ReferenceOrbit> preparedReference = nullptr);
+    ~BandRenderer();
+
+    // Renders rows [startY, endY) into `pixels`, which holds just those rows.
+    void render(int startY, int endY, sf::Uint8* pixels);
+    // What the kernels did over every band rendered so far.
+    KernelCounters getCounters() const;
+
+private:
+    std::shared_ptr<const std::vector<float>> sampleEqualization();
+
+    RenderThreadPool& pool;
+    RenderState state;
+    int width;
+    int height;
+    std::unique_ptr<ReferenceOrbit> reference;
+    std::unique_ptr<FractalKernels> kernels;
+    std::vector<AntiAliasingScratch> scratch;
+    std::vector<KernelCounters> counters;
+    Coloring coloring;
+};
+
+enum class SeedAnimation {
+    Off,
+    // The seed goes round the circle of JULIA_PATH_RADIUS.
+    Path,
+    // The seed is the point under the mouse.
+    Mouse
+};
+
+// Renders the frames of a Julia set whose seed keeps moving, at whatever
+// resolution keeps up with TARGET_FPS. Frames are pipelined: the pool
+// iterates and colors the next frame into the back buffer while the event
+// loop uploads and draws the one before from the front buffer. Each frame
+// is sized from the iteration rate and iterations per pixel of the frames
+// before, and stretched over the window.
+class SeedAnimator {
+public:
+    explicit SeedAnimator(RenderThreadPool& pool);
+    ~SeedAnimator();
+
+    // Starts a frame of `state` for a `width` x `height` window. Call only
+    // while no frame is in flight.
+    void start(const RenderState& state, int width, int height);
+    // Returns true, once, when the frame in flight completed; it becomes the
+    // front frame.
+    bool finish();
+    // Stops the frame in flight and waits until no worker touches the buffers.
+    void cancel();
+
+    // Copies the front frame into the top left corner of `texture` and
+    // stretches `sprite` over the `windowWidth` x `windowHeight` window.
+    // Frames larger than the texture, from before a resize, are skipped.
+    void present(sf::Texture& texture, sf::Sprite& sprite, int windowWidth, int windowHeight) const;
+
+    bool isBusy() const { return busy; }
+    int getFrameWidth() const { return frontWidth; }
+    int getFrameHeight() const { return frontHeight; }
+    // Milliseconds the pool spent on the front frame.
+    double getFrameTime() const { return frameTime; }
+    const RenderBudget& getBudget() const { return budget; }
+    // What the kernels did for the front frame.
+    const KernelCounters& getCounters() const { return frameCounters; }
+
+private:
+    RenderThreadPool& pool;
+    std::vector<AntiAliasingScratch> scratch;
+    std::vector<KernelCounters> counters;
+    std::vector<RenderTile> tiles;
+
+    // The frame in flight and what it renders with. Deep zooms keep the
+    // reference orbit until the center or the formula moves.
+    RenderState snapshot;
+    std::unique_ptr<ReferenceOrbit> reference;
+    RenderState referenceState;
+    std::unique_ptr<FractalKernels> kernels;
+    Coloring coloring{ RenderState() };
+
+    std::vector<sf::Uint8> backPixels;
+    std::vector<sf::Uint8> frontPixels;
+    int backWidth = 0;
+    int backHeight = 0;
+    int frontWidth = 0;
+    int frontHeight = 0;
+
+    RenderBudget budget;
+    double frameTime = 0;
+    KernelCounters frameCounters;
+    bool busy = false;
 };
 
-void renderFractalRegion(sf::Uint8* pixels, const RenderState& state, int startY, int endY, int width, int height);
-void renderPreview(sf::Uint8* pixels, const RenderState& state, int width, int height, int downscale);
 void saveScreenshot(const sf::Texture& texture, const RenderState& state);
-std::string getInfoString(const RenderState& state, double mouseX, double mouseY);
+// `height` is the one of the window, which decides the precision.
+// Writes the overlay's description of the view over `info`, which keeps
+// its storage, so a frame repeating an earlier description allocates nothing.
+void writeInfoString(std::string& info, const RenderState& state, int height);
 
 const std::vector<std::vector<sf::Color>> PALETTES = {
     {
@@ -66,365 +1183,5259 @@ const std::vector<std::vector<sf::Color>> PALETTES = {
     {
         sf::Color(0, 0, 0), sf::Color(255, 255, 255),
     }
-};
-
-inline sf::Color interpolateColors(const sf::Color& c1, const sf::Color& c2, double factor) {
-    return sf::Color(
-        static_cast<sf::Uint8>(c1.r + factor * (c2.r - c1.r)),
-        static_cast<sf::Uint8>(c1.g + factor * (c2.g - c1.g)),
-        static_cast<sf::Uint8>(c1.b + factor * (c2.b - c1.b))
-    );
+};
+
+inline sf::Color interpolateColors(const sf::Color& c1, const sf::Color& c2, double factor) {
+    return sf::Color(
+        static_cast<sf::Uint8>(c1.r + factor * (c2.r - c1.r)),
+        static_cast<sf::Uint8>(c1.g + factor * (c2.g - c1.g)),
+        static_cast<sf::Uint8>(c1.b + factor * (c2.b - c1.b))
+    );
+}
+
+ColorLut::ColorLut(const std::vector<sf::Color>& palette) : colors(palette.size() * COLOR_LUT_STEPS) {
+    for (size_t entry = 0; entry < palette.size(); entry++) {
+        const sf::Color& next = palette[(entry + 1) % palette.size()];
+        for (int step = 0; step < COLOR_LUT_STEPS; step++) {
+            colors[entry * COLOR_LUT_STEPS + step] =
+                interpolateColors(palette[entry], next, static_cast<double>(step) / COLOR_LUT_STEPS);
+        }
+    }
+}
+
+const std::vector<ColorLut> PALETTE_LUTS(PALETTES.begin(), PALETTES.end());
+
+bool usesHistogramColoring(const RenderState& state) {
+    return state.histogramColoring && !state.stripes;
+}
+
+Coloring::Coloring(const RenderState& state, std::shared_ptr<const std::vector<float>> equalization)
+    : lut(&PALETTE_LUTS[state.colorScheme % PALETTE_LUTS.size()]), stripes(state.stripes),
+    scale(state.stripes ? state.stripeIntensity : state.colorDensity),
+    period(static_cast<double>(lut->colors.size() / COLOR_LUT_STEPS)), inversePeriod(1 / period),
+    lastIndex(static_cast<int>(lut->colors.size()) - 1) {
+    bool matches = equalization && equalization->size() == static_cast<size_t>(state.maxIterations) + 1;
+    if (usesHistogramColoring(state) && matches) {
+        this->equalization = std::move(equalization);
+        scale = period * state.colorDensity * HISTOGRAM_PALETTE_CYCLES;
+    }
+}
+
+// The share of escaped pixels below `smoothIteration`, interpolated inside
+// its bin, scaled to palette entries.
+inline double Coloring::getEqualizedPosition(double smoothIteration) const {
+    const float* shares = equalization->data();
+    int bins = static_cast<int>(equalization->size()) - 1;
+    int bin = std::max(0, std::min(static_cast<int>(smoothIteration), bins - 1));
+    double fraction = std::max(0.0, std::min(smoothIteration - bin, 1.0));
+    return (shares[bin] + fraction * (shares[bin + 1] - shares[bin])) * scale;
+}
+
+sf::Color Coloring::getColor(const ReturnInfo& info) const {
+    if (info.iteration == -1) {
+        return sf::Color(0, 0, 0);
+    }
+
+    double value = stripes ? info.stripeAverage : info.smoothIteration;
+    return lut->colors[getIndex(equalization ? getEqualizedPosition(value) : value * scale)];
+}
+
+inline void writePixel(sf::Uint8* pixels, int pixelIndex, const sf::Color& color) {
+    pixels[pixelIndex] = color.r;
+    pixels[pixelIndex + 1] = color.g;
+    pixels[pixelIndex + 2] = color.b;
+    pixels[pixelIndex + 3] = 255;
+}
+
+enum FractalType {
+    FRACTAL_MANDELBROT = 0,
+    FRACTAL_BURNING_SHIP = 1
+};
+
+// Stripe frequencies up to this that are whole numbers take the multiple-angle
+// path of getStripeTerm; others call atan2 and sin on every iteration.
+constexpr int MAX_WHOLE_STRIPE_FREQUENCY = 1024;
+
+// `frequency` as the integer getStripeTerm expands, or 0 when it has none.
+inline int getWholeStripeFrequency(float frequency) {
+    if (frequency < 1 || frequency > MAX_WHOLE_STRIPE_FREQUENCY || frequency != std::floor(frequency)) return 0;
+    return static_cast<int>(frequency);
+}
+
+// sin^2(k arg z) = (1 - cos(2k arg z)) / 2, and for whole k the cosine is the
+// real part of (z^2 / |z|^2)^k, which takes a division and a few complex
+// multiplies from the squares the loop already has.
+inline double getStripeTerm(double zr, double zi, double zr2, double zi2, float frequency, int wholeFrequency) {
+    if (wholeFrequency == 0) {
+        double stripe = sin(atan2(zi, zr) * frequency);
+        return stripe * stripe;
+    }
+
+    double norm = zr2 + zi2;
+    if (norm == 0) return 0;
+    double ur = (zr2 - zi2) / norm;
+    double ui = 2 * zr * zi / norm;
+    double pr = 1;
+    double pi = 0;
+    for (int k = wholeFrequency;;) {
+        if (k & 1) {
+            double nextPr = pr * ur - pi * ui;
+            pi = pr * ui + pi * ur;
+            pr = nextPr;
+        }
+        k >>= 1;
+        if (k == 0) break;
+        double nextUr = ur * ur - ui * ui;
+        ui = 2 * ur * ui;
+        ur = nextUr;
+    }
+    return 0.5 * (1 - pr);
+}
+
+// The average of `count` stripe terms ending in `last`, blended toward the
+// average without `last` as the escape gets deeper (|z|^2 from R^2 to R^4),
+// which is where one iteration fewer would have escaped. That keeps the
+// stripes continuous across iteration bands. Orbits that never escaped (the
+// inner calculation) keep the plain average.
+inline double getStripeAverage(double sum, double last, int count, double magnitudeSquared) {
+    if (count == 0) return 0;
+    double average = sum / count;
+    if (count == 1 || magnitudeSquared < ESCAPE_RADIUS_SQUARED) return average;
+    double previous = (sum - last) / (count - 1);
+    double weight = std::clamp(std::log2(std::log(magnitudeSquared) / std::log(ESCAPE_RADIUS_SQUARED)), 0.0, 1.0);
+    return average + weight * (previous - average);
+}
+
+// The escape-time kernel is instantiated once per combination of fractal type
+// and feature flags so the hot loop carries no per-iteration branches. New
+// formulas get a FractalType value, a branch in the `if constexpr` chains of
+// this kernel and FRACTAL_SIMD_ROW_KERNEL, and a case in selectKernels.
+//
+// Without stripes or the inner calculation only escape matters, so the loop
+// also runs a Brent-style periodicity check: it saves the orbit 8, 16, 32, ...
+// iterations after its start and reports the point as interior (-1) once the
+// orbit comes back to the saved point.
+//
+// continueFractal iterates from `orbit`, which holds the iteration count and
+// the point to start from, on formula c = (cr, ci), and leaves the end of the
+// orbit in it. `stripeSum` is the stripe sum up to the start.
+template <int Type, bool Stripes, bool InnerCalculation>
+inline ReturnInfo continueFractal(double cr, double ci, int maxIter, float stripeFrequency, double stripeSum,
+    OrbitState& orbit, KernelCounters& counters) {
+    constexpr bool Periodicity = !Stripes && !InnerCalculation;
+
+    double zr = orbit.zr;
+    double zi = orbit.zi;
+    double zr2 = zr * zr;
+    double zi2 = zi * zi;
+    int wholeFrequency = getWholeStripeFrequency(stripeFrequency);
+    double stripe = 0;
+    int first = orbit.iteration;
+    int i = first;
+    double savedZr = zr;
+    double savedZi = zi;
+    int nextSave = PERIODICITY_FIRST_CHECK;
+
+    ReturnInfo iterationInfo;
+
+    while (zr2 + zi2 < ESCAPE_RADIUS_SQUARED) {
+        if constexpr (Type == FRACTAL_MANDELBROT) {
+            zi = 2 * zr * zi;
+        }
+        else {
+            zi = 2 * fabs(zr * zi);
+        }
+        zi += ci;
+        zr = zr2 - zi2 + cr;
+        zr2 = zr * zr;
+        zi2 = zi * zi;
+        if constexpr (Stripes) {
+            stripe = getStripeTerm(zr, zi, zr2, zi2, stripeFrequency, wholeFrequency);
+            stripeSum += stripe;
+        }
+        i++;
+        if (i == maxIter) {
+            counters.executedIterations += i - first;
+            // An orbit that escaped on the last iteration has nothing left to carry on.
+            orbit = { zr2 + zi2 < ESCAPE_RADIUS_SQUARED ? OrbitEnd::Saved : OrbitEnd::Limit, i, zr, zi };
+            if constexpr (InnerCalculation) {
+                iterationInfo.iteration = i;
+                iterationInfo.smoothIteration = i + 1 - log(log(zr2 + zi2) / 2) / log(2);
+            }
+            else {
+                iterationInfo.iteration = -1;
+            }
+            iterationInfo.stripeAverage = Stripes ? getStripeAverage(stripeSum, stripe, i, zr2 + zi2) : 0;
+            return iterationInfo;
+        }
+        if constexpr (Periodicity) {
+            if (i - first == nextSave) {
+                savedZr = zr;
+                savedZi = zi;
+                nextSave *= 2;
+            }
+            else if ((i - first) % PERIODICITY_CHECK_INTERVAL == 0 &&
+                (zr - savedZr) * (zr - savedZr) + (zi - savedZi) * (zi - savedZi) < PERIODICITY_TOLERANCE_SQUARED) {
+                counters.periodicityExits++;
+                counters.executedIterations += i - first;
+                orbit.end = OrbitEnd::Final;
+                iterationInfo.iteration = -1;
+                return iterationInfo;
+            }
+        }
+    }
+
+    counters.executedIterations += i - first;
+    orbit.end = OrbitEnd::Final;
+    iterationInfo.iteration = i;
+    iterationInfo.smoothIteration = i + 1 - log(log(zr2 + zi2) / 2) / log(2);
+    iterationInfo.stripeAverage = Stripes ? getStripeAverage(stripeSum, stripe, i, zr2 + zi2) : 0;
+    return iterationInfo;
+}
+
+template <int Type, bool IsJulia, bool Stripes, bool InnerCalculation>
+inline ReturnInfo calculateFractal(double cr, double ci, double jr, double ji, int maxIter, float stripeFrequency,
+    OrbitState& orbit, KernelCounters& counters) {
+    ReturnInfo iterationInfo;
+
+    if constexpr (!InnerCalculation && !IsJulia && Type == FRACTAL_MANDELBROT) {
+        double q = (cr - 0.25) * (cr - 0.25) + ci * ci;
+        if (q * (q + (cr - 0.25)) < 0.25 * ci * ci) {
+            counters.cardioidSkips++;
+            orbit.end = OrbitEnd::Final;
+            iterationInfo.iteration = -1;
+            return iterationInfo;
+        }
+
+        if ((cr + 1.0) * (cr + 1.0) + ci * ci < 0.0625) {
+            counters.cardioidSkips++;
+            orbit.end = OrbitEnd::Final;
+            iterationInfo.iteration = -1;
+            return iterationInfo;
+        }
+    }
+
+    orbit = { OrbitEnd::Final, 0, IsJulia ? cr : 0, IsJulia ? ci : 0 };
+    return continueFractal<Type, Stripes, InnerCalculation>(IsJulia ? jr : cr, IsJulia ? ji : ci, maxIter,
+        stripeFrequency, 0, orbit, counters);
+}
+
+template <int Type, bool IsJulia, bool Stripes, bool InnerCalculation>
+inline ReturnInfo calculateFractal(double cr, double ci, double jr, double ji, int maxIter, float stripeFrequency,
+    KernelCounters& counters) {
+    OrbitState orbit;
+    return calculateFractal<Type, IsJulia, Stripes, InnerCalculation>(cr, ci, jr, ji, maxIter, stripeFrequency,
+        orbit, counters);
+}
+
+// Row kernels: evaluate the pixels xs[0..count) of one row. Taking a list of
+// columns lets callers skip pixels whose results are already known.
+// The SIMD versions iterate a whole register of adjacent pixels at once and
+// freeze each lane as soon as it escapes, so escaped lanes keep the same
+// zr2/zi2 the scalar loop would have stopped with. Their resume versions load
+// each lane's saved orbit and also freeze lanes one by one at the limit.
+enum class SimdLevel {
+    Scalar,
+    AVX2,
+    AVX512
+};
+
+const char* getSimdLevelName(SimdLevel level) {
+    switch (level) {
+    case SimdLevel::AVX2: return "AVX2";
+    case SimdLevel::AVX512: return "AVX-512";
+    default: return "scalar";
+    }
+}
+
+// Picks the widest ISA the CPU and OS support. FRACTAL_SIMD=scalar|avx2|avx512
+// caps the choice, which is handy for comparing kernels on one machine.
+SimdLevel detectSimdLevel() {
+    SimdLevel level = SimdLevel::Scalar;
+
+#if FRACTAL_X86_SIMD
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    int maxLeaf = info[0];
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    if (osxsave && maxLeaf >= 7) {
+        unsigned long long xcr0 = _xgetbv(0);
+        __cpuidex(info, 7, 0);
+        if ((xcr0 & 0x6) == 0x6 && (info[1] & (1 << 5))) level = SimdLevel::AVX2;
+        if ((xcr0 & 0xE6) == 0xE6 && (info[1] & (1 << 16))) level = SimdLevel::AVX512;
+    }
+#else
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) level = SimdLevel::AVX2;
+    if (__builtin_cpu_supports("avx512f")) level = SimdLevel::AVX512;
+#endif
+#endif
+
+    if (const char* requested = std::getenv("FRACTAL_SIMD")) {
+        std::string name = requested;
+        if (name == "scalar") level = SimdLevel::Scalar;
+        else if (name == "avx2" && level == SimdLevel::AVX512) level = SimdLevel::AVX2;
+    }
+
+    return level;
+}
+
+const SimdLevel SIMD_LEVEL = detectSimdLevel();
+
+enum class Precision {
+    Float,
+    Double,
+    Perturbation
+};
+
+const char* getPrecisionName(Precision precision) {
+    switch (precision) {
+    case Precision::Float: return "float";
+    case Precision::Perturbation: return "perturbation";
+    default: return "double";
+    }
+}
+
+// The float kernels are SIMD only. FRACTAL_FLOAT=off keeps shallow frames on
+// double, for comparing the two.
+bool detectFloatKernels() {
+    if (SIMD_LEVEL == SimdLevel::Scalar) return false;
+    const char* requested = std::getenv("FRACTAL_FLOAT");
+    return !requested || std::string(requested) != "off";
+}
+
+const bool FLOAT_KERNELS = detectFloatKernels();
+
+// Whether the pixels of a `height` pixel render of `state` are coarse enough
+// for float coordinates.
+bool hasFloatPixels(const RenderState& state, int height) {
+    double magnitude = std::max(1.0, std::max(std::fabs(state.viewportX), std::fabs(state.viewportY)));
+    return state.viewportHeight / height > FLOAT_PIXEL_SIZE * magnitude;
+}
+
+// Rows of a `height` pixel render of `state` run in float while its pixels
+// are coarse enough, in double below that, and with perturbation once even
+// double runs out. Stripe frames have no SIMD kernel and stay on double, and
+// so do limits float can't count to.
+Precision selectPrecision(const RenderState& state, int height) {
+    if (usesPerturbation(state)) return Precision::Perturbation;
+    if (FLOAT_KERNELS && !state.stripes && state.maxIterations < FLOAT_MAX_ITERATIONS &&
+        hasFloatPixels(state, height)) {
+        return Precision::Float;
+    }
+    return Precision::Double;
+}
+
+using PixelKernel = ReturnInfo(*)(double cr, double ci, double jr, double ji, int maxIter, float stripeFrequency,
+    KernelCounters& counters);
+using RowKernel = void(*)(const RenderState& state, double originX, double pixelWidth, double ci,
+    const int* xs, int count, ReturnInfo* out, OrbitState* orbits, KernelCounters& counters);
+
+struct ReferenceOrbit;
+using PerturbationKernel = ReturnInfo(*)(const RenderState& state, const ReferenceOrbit& reference,
+    double deltaR, double deltaI, KernelCounters& counters);
+
+// The pixel kernel serves off-grid samples (anti-aliasing); rows go through the
+// row kernel, which is the SIMD one whenever the CPU and the flags allow it.
+// With a reference orbit set both go through the perturbation kernel instead,
+// and coordinates are measured from the view center: callers place pixels
+// around (centerX, centerY) and stay unaware of which kernels run.
+//
+// Rows can also hand back how each orbit ended (`orbits`, when not null), and
+// the resume kernel carries on pixels whose orbit was saved under a lower
+// limit: `out` and `orbits` come in with the pixel's last result and orbit
+// and go out with the new ones. Perturbation keeps no orbits, so with a
+// reference set resumed pixels start over.
+struct FractalKernels {
+    PixelKernel pixelKernel;
+    RowKernel rowKernel;
+    RowKernel resumeKernel;
+    PerturbationKernel perturbationKernel;
+    const ReferenceOrbit* reference = nullptr;
+    double centerX = 0;
+    double centerY = 0;
+
+    ReturnInfo pixel(const RenderState& state, double cr, double ci, KernelCounters& counters) const {
+        if (reference) return perturbationKernel(state, *reference, cr, ci, counters);
+        return pixelKernel(cr, ci, state.juliaX, state.juliaY, state.maxIterations, state.stripeFrequency, counters);
+    }
+
+    void row(const RenderState& state, double originX, double pixelWidth, double ci,
+        const int* xs, int count, ReturnInfo* out, OrbitState* orbits, KernelCounters& counters) const {
+        if (!reference) {
+            rowKernel(state, originX, pixelWidth, ci, xs, count, out, orbits, counters);
+            return;
+        }
+        for (int k = 0; k < count; k++) {
+            out[k] = perturbationKernel(state, *reference, originX + xs[k] * pixelWidth, ci, counters);
+            if (!orbits) continue;
+            bool reachedLimit = out[k].iteration == -1 || out[k].iteration >= state.maxIterations;
+            orbits[k] = { reachedLimit ? OrbitEnd::Limit : OrbitEnd::Final, state.maxIterations, 0, 0 };
+        }
+    }
+
+    void resume(const RenderState& state, double originX, double pixelWidth, double ci,
+        const int* xs, int count, ReturnInfo* out, OrbitState* orbits, KernelCounters& counters) const {
+        if (!reference) {
+            resumeKernel(state, originX, pixelWidth, ci, xs, count, out, orbits, counters);
+            return;
+        }
+        row(state, originX, pixelWidth, ci, xs, count, out, orbits, counters);
+    }
+};
+
+template <int Type, bool IsJulia, bool Stripes, bool InnerCalculation>
+inline void calculateFractalRowScalar(const RenderState& state, double originX, double pixelWidth, double ci,
+    const int* xs, int count, ReturnInfo* out, OrbitState* orbits, KernelCounters& counters) {
+    for (int k = 0; k < count; k++) {
+        double cr = originX + xs[k] * pixelWidth;
+        OrbitState orbit;
+        out[k] = calculateFractal<Type, IsJulia, Stripes, InnerCalculation>(cr, ci, state.juliaX, state.juliaY,
+            state.maxIterations, state.stripeFrequency, orbit, counters);
+        if (orbits) orbits[k] = orbit;
+    }
+}
+
+template <int Type, bool IsJulia, bool Stripes, bool InnerCalculation>
+inline void continueFractalRowScalar(const RenderState& state, double originX, double pixelWidth, double ci,
+    const int* xs, int count, ReturnInfo* out, OrbitState* orbits, KernelCounters& counters) {
+    for (int k = 0; k < count; k++) {
+        double cr = IsJulia ? state.juliaX : originX + xs[k] * pixelWidth;
+        double ciActual = IsJulia ? state.juliaY : ci;
+        double stripeSum = Stripes ? out[k].stripeAverage * orbits[k].iteration : 0;
+        out[k] = continueFractal<Type, Stripes, InnerCalculation>(cr, ciActual, state.maxIterations,
+            state.stripeFrequency, stripeSum, orbits[k], counters);
+    }
+}
+
+#if FRACTAL_X86_SIMD
+
+// Multiply-add contraction is kept off: fusing the multiply-adds would change
+// the rounding and the SIMD output would no longer match the scalar kernel.
+#if defined(_MSC_VER)
+#define FRACTAL_TARGET_AVX2
+#define FRACTAL_TARGET_AVX512
+#elif defined(__clang__)
+#define FRACTAL_TARGET_AVX2 __attribute__((target("avx2")))
+#define FRACTAL_TARGET_AVX512 __attribute__((target("avx512f")))
+#else
+#define FRACTAL_TARGET_AVX2 __attribute__((target("avx2"), optimize("fp-contract=off")))
+#define FRACTAL_TARGET_AVX512 __attribute__((target("avx512f"), optimize("fp-contract=off")))
+#endif
+
+struct Avx2Double {
+    using Scalar = double;
+    using Vec = __m256d;
+    using Mask = __m256d;
+    static constexpr int Lanes = 4;
+
+    FRACTAL_TARGET_AVX2 static inline Vec set1(double v) { return _mm256_set1_pd(v); }
+    FRACTAL_TARGET_AVX2 static inline Vec loadColumns(const int* xs) {
+        return _mm256_cvtepi32_pd(_mm_loadu_si128(reinterpret_cast<const __m128i*>(xs)));
+    }
+    FRACTAL_TARGET_AVX2 static inline Vec add(Vec a, Vec b) { return _mm256_add_pd(a, b); }
+    FRACTAL_TARGET_AVX2 static inline Vec sub(Vec a, Vec b) { return _mm256_sub_pd(a, b); }
+    FRACTAL_TARGET_AVX2 static inline Vec mul(Vec a, Vec b) { return _mm256_mul_pd(a, b); }
+    FRACTAL_TARGET_AVX2 static inline Vec abs(Vec a) { return _mm256_andnot_pd(_mm256_set1_pd(-0.0), a); }
+    FRACTAL_TARGET_AVX2 static inline Mask lessThan(Vec a, Vec b) { return _mm256_cmp_pd(a, b, _CMP_LT_OQ); }
+    FRACTAL_TARGET_AVX2 static inline Mask maskAnd(Mask a, Mask b) { return _mm256_and_pd(a, b); }
+    FRACTAL_TARGET_AVX2 static inline Mask maskOr(Mask a, Mask b) { return _mm256_or_pd(a, b); }
+    FRACTAL_TARGET_AVX2 static inline Mask maskAndNot(Mask a, Mask b) { return _mm256_andnot_pd(b, a); }
+    FRACTAL_TARGET_AVX2 static inline Mask maskNone() { return _mm256_setzero_pd(); }
+    FRACTAL_TARGET_AVX2 static inline bool any(Mask m) { return _mm256_movemask_pd(m) != 0; }
+    FRACTAL_TARGET_AVX2 static inline int bits(Mask m) { return _mm256_movemask_pd(m); }
+    FRACTAL_TARGET_AVX2 static inline Vec select(Mask m, Vec ifTrue, Vec ifFalse) { return _mm256_blendv_pd(ifFalse, ifTrue, m); }
+    FRACTAL_TARGET_AVX2 static inline Vec increment(Vec counter, Mask m) {
+        return _mm256_add_pd(counter, _mm256_and_pd(m, _mm256_set1_pd(1.0)));
+    }
+    FRACTAL_TARGET_AVX2 static inline Vec load(const double* in) { return _mm256_loadu_pd(in); }
+    FRACTAL_TARGET_AVX2 static inline void store(double* out, Vec a) { _mm256_storeu_pd(out, a); }
+};
+
+struct Avx512Double {
+    using Scalar = double;
+    using Vec = __m512d;
+    using Mask = __mmask8;
+    static constexpr int Lanes = 8;
+
+    FRACTAL_TARGET_AVX512 static inline Vec set1(double v) { return _mm512_set1_pd(v); }
+    FRACTAL_TARGET_AVX512 static inline Vec loadColumns(const int* xs) {
+        return _mm512_cvtepi32_pd(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(xs)));
+    }
+    FRACTAL_TARGET_AVX512 static inline Vec add(Vec a, Vec b) { return _mm512_add_pd(a, b); }
+    FRACTAL_TARGET_AVX512 static inline Vec sub(Vec a, Vec b) { return _mm512_sub_pd(a, b); }
+    FRACTAL_TARGET_AVX512 static inline Vec mul(Vec a, Vec b) { return _mm512_mul_pd(a, b); }
+    FRACTAL_TARGET_AVX512 static inline Vec abs(Vec a) { return _mm512_abs_pd(a); }
+    FRACTAL_TARGET_AVX512 static inline Mask lessThan(Vec a, Vec b) { return _mm512_cmp_pd_mask(a, b, _CMP_LT_OQ); }
+    FRACTAL_TARGET_AVX512 static inline Mask maskAnd(Mask a, Mask b) { return a & b; }
+    FRACTAL_TARGET_AVX512 static inline Mask maskOr(Mask a, Mask b) { return a | b; }
+    FRACTAL_TARGET_AVX512 static inline Mask maskAndNot(Mask a, Mask b) { return a & ~b; }
+    FRACTAL_TARGET_AVX512 static inline Mask maskNone() { return 0; }
+    FRACTAL_TARGET_AVX512 static inline bool any(Mask m) { return m != 0; }
+    FRACTAL_TARGET_AVX512 static inline int bits(Mask m) { return m; }
+    FRACTAL_TARGET_AVX512 static inline Vec select(Mask m, Vec ifTrue, Vec ifFalse) { return _mm512_mask_blend_pd(m, ifFalse, ifTrue); }
+    FRACTAL_TARGET_AVX512 static inline Vec increment(Vec counter, Mask m) {
+        return _mm512_mask_add_pd(counter, m, counter, _mm512_set1_pd(1.0));
+    }
+    FRACTAL_TARGET_AVX512 static inline Vec load(const double* in) { return _mm512_loadu_pd(in); }
+    FRACTAL_TARGET_AVX512 static inline void store(double* out, Vec a) { _mm512_storeu_pd(out, a); }
+};
+
+// Twice the lanes of the double traits. Constants arrive as doubles and are
+// rounded once here, so the shared kernel body stays the same.
+struct Avx2Float {
+    using Scalar = float;
+    using Vec = __m256;
+    using Mask = __m256;
+    static constexpr int Lanes = 8;
+
+    FRACTAL_TARGET_AVX2 static inline Vec set1(double v) { return _mm256_set1_ps(static_cast<float>(v)); }
+    FRACTAL_TARGET_AVX2 static inline Vec loadColumns(const int* xs) {
+        return _mm256_cvtepi32_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(xs)));
+    }
+    FRACTAL_TARGET_AVX2 static inline Vec add(Vec a, Vec b) { return _mm256_add_ps(a, b); }
+    FRACTAL_TARGET_AVX2 static inline Vec sub(Vec a, Vec b) { return _mm256_sub_ps(a, b); }
+    FRACTAL_TARGET_AVX2 static inline Vec mul(Vec a, Vec b) { return _mm256_mul_ps(a, b); }
+    FRACTAL_TARGET_AVX2 static inline Vec abs(Vec a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+    FRACTAL_TARGET_AVX2 static inline Mask lessThan(Vec a, Vec b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+    FRACTAL_TARGET_AVX2 static inline Mask maskAnd(Mask a, Mask b) { return _mm256_and_ps(a, b); }
+    FRACTAL_TARGET_AVX2 static inline Mask maskOr(Mask a, Mask b) { return _mm256_or_ps(a, b); }
+    FRACTAL_TARGET_AVX2 static inline Mask maskAndNot(Mask a, Mask b) { return _mm256_andnot_ps(b, a); }
+    FRACTAL_TARGET_AVX2 static inline Mask maskNone() { return _mm256_setzero_ps(); }
+    FRACTAL_TARGET_AVX2 static inline bool any(Mask m) { return _mm256_movemask_ps(m) != 0; }
+    FRACTAL_TARGET_AVX2 static inline int bits(Mask m) { return _mm256_movemask_ps(m); }
+    FRACTAL_TARGET_AVX2 static inline Vec select(Mask m, Vec ifTrue, Vec ifFalse) { return _mm256_blendv_ps(ifFalse, ifTrue, m); }
+    FRACTAL_TARGET_AVX2 static inline Vec increment(Vec counter, Mask m) {
+        return _mm256_add_ps(counter, _mm256_and_ps(m, _mm256_set1_ps(1.0f)));
+    }
+    FRACTAL_TARGET_AVX2 static inline Vec load(const float* in) { return _mm256_loadu_ps(in); }
+    FRACTAL_TARGET_AVX2 static inline void store(float* out, Vec a) { _mm256_storeu_ps(out, a); }
+};
+
+struct Avx512Float {
+    using Scalar = float;
+    using Vec = __m512;
+    using Mask = __mmask16;
+    static constexpr int Lanes = 16;
+
+    FRACTAL_TARGET_AVX512 static inline Vec set1(double v) { return _mm512_set1_ps(static_cast<float>(v)); }
+    FRACTAL_TARGET_AVX512 static inline Vec loadColumns(const int* xs) {
+        return _mm512_cvtepi32_ps(_mm512_loadu_si512(xs));
+    }
+    FRACTAL_TARGET_AVX512 static inline Vec add(Vec a, Vec b) { return _mm512_add_ps(a, b); }
+    FRACTAL_TARGET_AVX512 static inline Vec sub(Vec a, Vec b) { return _mm512_sub_ps(a, b); }
+    FRACTAL_TARGET_AVX512 static inline Vec mul(Vec a, Vec b) { return _mm512_mul_ps(a, b); }
+    FRACTAL_TARGET_AVX512 static inline Vec abs(Vec a) { return _mm512_abs_ps(a); }
+    FRACTAL_TARGET_AVX512 static inline Mask lessThan(Vec a, Vec b) { return _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ); }
+    FRACTAL_TARGET_AVX512 static inline Mask maskAnd(Mask a, Mask b) { return a & b; }
+    FRACTAL_TARGET_AVX512 static inline Mask maskOr(Mask a, Mask b) { return a | b; }
+    FRACTAL_TARGET_AVX512 static inline Mask maskAndNot(Mask a, Mask b) { return a & ~b; }
+    FRACTAL_TARGET_AVX512 static inline Mask maskNone() { return 0; }
+    FRACTAL_TARGET_AVX512 static inline bool any(Mask m) { return m != 0; }
+    FRACTAL_TARGET_AVX512 static inline int bits(Mask m) { return m; }
+    FRACTAL_TARGET_AVX512 static inline Vec select(Mask m, Vec ifTrue, Vec ifFalse) { return _mm512_mask_blend_ps(m, ifFalse, ifTrue); }
+    FRACTAL_TARGET_AVX512 static inline Vec increment(Vec counter, Mask m) {
+        return _mm512_mask_add_ps(counter, m, counter, _mm512_set1_ps(1.0f));
+    }
+    FRACTAL_TARGET_AVX512 static inline Vec load(const float* in) { return _mm512_loadu_ps(in); }
+    FRACTAL_TARGET_AVX512 static inline void store(float* out, Vec a) { _mm512_storeu_ps(out, a); }
+};
+
+inline int popcount(int bits) {
+    int count = 0;
+    for (; bits != 0; bits &= bits - 1) count++;
+    return count;
+}
+
+// GCC and Clang only inline intrinsics into functions compiled for the same
+// ISA, and a target attribute can't depend on a template argument, so the
+// shared body is stamped out once per ISA below.
+#define FRACTAL_SIMD_ROW_KERNEL(V)                                                          \
+{                                                                                           \
+    using Vec = V::Vec;                                                                     \
+    using Mask = V::Mask;                                                                   \
+    using Scalar = V::Scalar;                                                               \
+    constexpr int lanes = V::Lanes;                                                         \
+                                                                                            \
+    const Vec two = V::set1(2.0);                                                           \
+    const Vec escapeRadius = V::set1(ESCAPE_RADIUS_SQUARED);                                \
+    const Vec pixelWidthV = V::set1(pixelWidth);                                            \
+    const Vec originXV = V::set1(originX);                                                  \
+    const Vec ciV = V::set1(ci);                                                            \
+    const Vec periodicityTolerance = V::set1(PERIODICITY_TOLERANCE_SQUARED);                \
+    const Vec maxIterationsV = V::set1(state.maxIterations);                                \
+                                                                                            \
+    int k = 0;                                                                              \
+    for (; k + lanes <= count; k += lanes) {                                                \
+        Vec cr = V::add(originXV, V::mul(V::loadColumns(xs + k), pixelWidthV));             \
+        Vec zr = IsJulia ? cr : V::set1(0.0);                                               \
+        Vec zi = IsJulia ? ciV : V::set1(0.0);                                              \
+        Vec crActual = IsJulia ? V::set1(state.juliaX) : cr;                                \
+        Vec ciActual = IsJulia ? V::set1(state.juliaY) : ciV;                               \
+        Vec iterations = V::set1(0.0);                                                      \
+                                                                                            \
+        /* Resumed lanes start where their orbit stopped, each at its own */                \
+        /* count, so they also stop at the limit one by one. */                             \
+        alignas(64) Scalar laneStart[lanes] = {};                                           \
+        if constexpr (Resume) {                                                             \
+            alignas(64) Scalar startZr[lanes];                                              \
+            alignas(64) Scalar startZi[lanes];                                              \
+            for (int lane = 0; lane < lanes; lane++) {                                      \
+                startZr[lane] = static_cast<Scalar>(orbits[k + lane].zr);                   \
+                startZi[lane] = static_cast<Scalar>(orbits[k + lane].zi);                   \
+                laneStart[lane] = static_cast<Scalar>(orbits[k + lane].iteration);          \
+            }                                                                               \
+            zr = V::load(startZr);                                                          \
+            zi = V::load(startZi);                                                          \
+            iterations = V::load(laneStart);                                                \
+        }                                                                                   \
+                                                                                            \
+        Mask interior = V::maskNone();                                                      \
+        constexpr bool Cardioid = !Resume && !InnerCalculation && !IsJulia;                 \
+        if constexpr (Cardioid && Type == FRACTAL_MANDELBROT) {                             \
+            Vec xq = V::sub(cr, V::set1(0.25));                                             \
+            Vec q = V::add(V::mul(xq, xq), V::mul(ciV, ciV));                               \
+            Mask cardioid = V::lessThan(V::mul(q, V::add(q, xq)),                           \
+                V::mul(V::set1(0.25), V::mul(ciV, ciV)));                                   \
+            Vec xb = V::add(cr, V::set1(1.0));                                              \
+            Mask bulb = V::lessThan(V::add(V::mul(xb, xb), V::mul(ciV, ciV)),               \
+                V::set1(0.0625));                                                           \
+            interior = V::maskOr(cardioid, bulb);                                           \
+            counters.cardioidSkips += popcount(V::bits(interior));                          \
+        }                                                                                   \
+                                                                                            \
+        Vec zr2 = V::mul(zr, zr);                                                           \
+        Vec zi2 = V::mul(zi, zi);                                                           \
+        Mask active = V::maskAndNot(V::lessThan(V::add(zr2, zi2), escapeRadius), interior); \
+        Vec savedZr = zr;                                                                   \
+        Vec savedZi = zi;                                                                   \
+        int nextSave = PERIODICITY_FIRST_CHECK;                                             \
+                                                                                            \
+        for (int i = 0; (Resume || i < state.maxIterations) && V::any(active); i++) {       \
+            Vec newZi;                                                                      \
+            if constexpr (Type == FRACTAL_MANDELBROT) {                                     \
+                newZi = V::add(V::mul(V::mul(two, zr), zi), ciActual);                      \
+            }                                                                               \
+            else {                                                                          \
+                newZi = V::add(V::mul(two, V::abs(V::mul(zr, zi))), ciActual);              \
+            }                                                                               \
+            Vec newZr = V::add(V::sub(zr2, zi2), crActual);                                 \
+            zr = V::select(active, newZr, zr);                                              \
+            zi = V::select(active, newZi, zi);                                              \
+            zr2 = V::mul(zr, zr);                                                           \
+            zi2 = V::mul(zi, zi);                                                           \
+            iterations = V::increment(iterations, active);                                  \
+            active = V::maskAnd(active, V::lessThan(V::add(zr2, zi2), escapeRadius));       \
+            if constexpr (Resume) {                                                         \
+                active = V::maskAnd(active, V::lessThan(iterations, maxIterationsV));       \
+            }                                                                               \
+                                                                                            \
+            /* All lanes share the iteration count, so they save together. */               \
+            if constexpr (!InnerCalculation) {                                              \
+                if (i + 1 == nextSave) {                                                    \
+                    savedZr = zr;                                                           \
+                    savedZi = zi;                                                           \
+                    nextSave *= 2;                                                          \
+                }                                                                           \
+                else if ((i + 1) % PERIODICITY_CHECK_INTERVAL == 0 &&                       \
+                    (Resume || i + 1 < state.maxIterations)) {                              \
+                    Vec dr = V::sub(zr, savedZr);                                           \
+                    Vec di = V::sub(zi, savedZi);                                           \
+                    Mask periodic = V::maskAnd(active, V::lessThan(                         \
+                        V::add(V::mul(dr, dr), V::mul(di, di)), periodicityTolerance));     \
+                    if (V::any(periodic)) {                                                 \
+                        counters.periodicityExits += popcount(V::bits(periodic));           \
+                        interior = V::maskOr(interior, periodic);                           \
+                        active = V::maskAndNot(active, periodic);                           \
+                    }                                                                       \
+                }                                                                           \
+            }                                                                               \
+        }                                                                                   \
+                                                                                            \
+        alignas(64) Scalar laneIterations[lanes];                                           \
+        alignas(64) Scalar laneZr[lanes];                                                   \
+        alignas(64) Scalar laneZi[lanes];                                                   \
+        alignas(64) Scalar laneZr2[lanes];                                                  \
+        alignas(64) Scalar laneZi2[lanes];                                                  \
+        V::store(laneIterations, iterations);                                               \
+        V::store(laneZr, zr);                                                               \
+        V::store(laneZi, zi);                                                               \
+        V::store(laneZr2, zr2);                                                             \
+        V::store(laneZi2, zi2);                                                             \
+        int interiorBits = V::bits(interior);                                               \
+        int insideBits = V::bits(V::lessThan(V::add(zr2, zi2), escapeRadius));              \
+                                                                                            \
+        for (int lane = 0; lane < lanes; lane++) {                                          \
+            ReturnInfo& info = out[k + lane];                                               \
+            int i = static_cast<int>(laneIterations[lane]);                                 \
+            int start = Resume ? static_cast<int>(laneStart[lane]) : 0;                     \
+            counters.executedIterations += i - start;                                       \
+            bool reachedLimit = i == state.maxIterations && !((interiorBits >> lane) & 1);  \
+            if (orbits) {                                                                   \
+                OrbitEnd end = !reachedLimit ? OrbitEnd::Final :                            \
+                    ((insideBits >> lane) & 1) ? OrbitEnd::Saved : OrbitEnd::Limit;         \
+                orbits[k + lane] = { end, i, laneZr[lane], laneZi[lane] };                  \
+            }                                                                               \
+            if (((interiorBits >> lane) & 1) ||                                             \
+                (i == state.maxIterations && !InnerCalculation)) {                          \
+                info.iteration = -1;                                                        \
+                continue;                                                                   \
+            }                                                                               \
+            info.iteration = i;                                                             \
+            double magnitude = static_cast<double>(laneZr2[lane]) + laneZi2[lane];          \
+            info.smoothIteration = i + 1 - log(log(magnitude) / 2) / log(2);                \
+            info.stripeAverage = 0;                                                         \
+        }                                                                                   \
+    }                                                                                       \
+                                                                                            \
+    if constexpr (Resume) {                                                                 \
+        continueFractalRowScalar<Type, IsJulia, false, InnerCalculation>(state, originX,    \
+            pixelWidth, ci, xs + k, count - k, out + k, orbits + k, counters);              \
+    }                                                                                       \
+    else {                                                                                  \
+        OrbitState* tailOrbits = orbits ? orbits + k : nullptr;                             \
+        calculateFractalRowScalar<Type, IsJulia, false, InnerCalculation>(state, originX,   \
+            pixelWidth, ci, xs + k, count - k, out + k, tailOrbits, counters);              \
+    }                                                                                       \
+}
+
+template <int Type, bool IsJulia, bool InnerCalculation, bool Resume>
+FRACTAL_TARGET_AVX2 void calculateFractalRowAvx2(const RenderState& state, double originX, double pixelWidth, double ci,
+    const int* xs, int count, ReturnInfo* out, OrbitState* orbits, KernelCounters& counters)
+FRACTAL_SIMD_ROW_KERNEL(Avx2Double)
+
+template <int Type, bool IsJulia, bool InnerCalculation, bool Resume>
+FRACTAL_TARGET_AVX512 void calculateFractalRowAvx512(const RenderState& state, double originX, double pixelWidth, double ci,
+    const int* xs, int count, ReturnInfo* out, OrbitState* orbits, KernelCounters& counters)
+FRACTAL_SIMD_ROW_KERNEL(Avx512Double)
+
+template <int Type, bool IsJulia, bool InnerCalculation, bool Resume>
+FRACTAL_TARGET_AVX2 void calculateFractalRowAvx2Float(const RenderState& state, double originX, double pixelWidth,
+    double ci, const int* xs, int count, ReturnInfo* out, OrbitState* orbits, KernelCounters& counters)
+FRACTAL_SIMD_ROW_KERNEL(Avx2Float)
+
+template <int Type, bool IsJulia, bool InnerCalculation, bool Resume>
+FRACTAL_TARGET_AVX512 void calculateFractalRowAvx512Float(const RenderState& state, double originX, double pixelWidth,
+    double ci, const int* xs, int count, ReturnInfo* out, OrbitState* orbits, KernelCounters& counters)
+FRACTAL_SIMD_ROW_KERNEL(Avx512Float)
+
+#endif
+
+// `length` perturbation steps from reference iteration m collapsed into one:
+// d(m + length) = A d(m) + B dc, valid while |d(m)|^2 < radiusSquared.
+struct ApproximationStep {
+    double ar, ai;
+    double br, bi;
+    double radiusSquared;
+};
+
+// The orbit of the view center, iterated in HighPrecision and kept as doubles.
+// It ends at maxIterations or at the first point outside the escape radius.
+// `approximations[k][j]` covers 2^k steps from iteration 1 + j * 2^k; it is
+// only built for the Mandelbrot formula without stripes.
+struct ReferenceOrbit {
+    std::vector<double> zr;
+    std::vector<double> zi;
+    int fractionLimbs = 0;
+    std::vector<std::vector<ApproximationStep>> approximations;
+};
+
+// Builds the approximation table of `orbit` for pixels up to `maxDelta` from
+// the reference in c. One step multiplies d by 2Z and adds dc, dropping d^2;
+// neighbouring steps then merge pairwise, each level doubling the length.
+void buildApproximations(ReferenceOrbit& orbit, double maxDelta) {
+    int last = static_cast<int>(orbit.zr.size()) - 1;
+    if (last < 2) return;
+
+    std::vector<ApproximationStep> steps(last - 1);
+    for (int m = 1; m < last; m++) {
+        double ar = 2 * orbit.zr[m];
+        double ai = 2 * orbit.zi[m];
+        double radius = APPROXIMATION_EPSILON * std::sqrt(ar * ar + ai * ai);
+        steps[m - 1] = { ar, ai, 1, 0, radius * radius };
+    }
+    orbit.approximations.push_back(std::move(steps));
+
+    while (orbit.approximations.back().size() >= 2) {
+        const std::vector<ApproximationStep>& below = orbit.approximations.back();
+        std::vector<ApproximationStep> merged(below.size() / 2);
+        for (size_t j = 0; j < merged.size(); j++) {
+            const ApproximationStep& x = below[2 * j];
+            const ApproximationStep& y = below[2 * j + 1];
+            ApproximationStep& step = merged[j];
+            step.ar = y.ar * x.ar - y.ai * x.ai;
+            step.ai = y.ar * x.ai + y.ai * x.ar;
+            step.br = y.ar * x.br - y.ai * x.bi + y.br;
+            step.bi = y.ar * x.bi + y.ai * x.br + y.bi;
+
+            // After x, |d| is at most |Ax||d| + |Bx| maxDelta, which has to
+            // stay inside the radius of y.
+            double scale = std::sqrt(x.ar * x.ar + x.ai * x.ai);
+            double slack = std::sqrt(y.radiusSquared) - std::sqrt(x.br * x.br + x.bi * x.bi) * maxDelta;
+            double radius = slack <= 0 ? 0 : (scale == 0 ? INFINITY : slack / scale);
+            step.radiusSquared = std::min(x.radiusSquared, radius * radius);
+        }
+        orbit.approximations.push_back(std::move(merged));
+    }
+}
+
+// The longest approximation from reference iteration m that is valid for a
+// delta of squared magnitude `deltaSquared` and at most `limit` steps long.
+// Steps only get less valid as they merge, so the search climbs from level 0.
+inline const ApproximationStep* findApproximation(const ReferenceOrbit& reference, int m, double deltaSquared,
+    int limit, int& length) {
+    const ApproximationStep* best = nullptr;
+    int index = m - 1;
+    for (size_t level = 0; level < reference.approximations.size(); level++) {
+        int levelLength = 1 << level;
+        if (levelLength > limit || index >= static_cast<int>(reference.approximations[level].size())) break;
+        const ApproximationStep& step = reference.approximations[level][index];
+        if (deltaSquared >= step.radiusSquared) break;
+        best = &step;
+        length = levelLength;
+        if (index & 1) break;
+        index >>= 1;
+    }
+    return best;
+}
+
+// Fractional limbs that resolve a pixel of `state` with room to spare.
+int getReferenceFractionLimbs(const RenderState& state) {
+    int bits = static_cast<int>(std::ceil(-std::log2(state.viewportHeight))) + 80;
+    return std::min(HIGH_PRECISION_LIMBS - 1, std::max(2, (bits + 31) / 32));
+}
+
+// Rebuilds the approximation tables of `orbit` for the view of `state`. The
+// orbit itself serves any view on the same center with at most as many
+// iterations, which lets a zoom video compute it once for its deepest frame.
+void prepareApproximations(ReferenceOrbit& orbit, const RenderState& state);
+
+ReferenceOrbit computeReferenceOrbit(const RenderState& state) {
+    ReferenceOrbit orbit;
+    orbit.fractionLimbs = getReferenceFractionLimbs(state);
+    int limbs = orbit.fractionLimbs;
+
+    HighPrecision zr = state.showJulia ? getCenterX(state) : HighPrecision();
+    HighPrecision zi = state.showJulia ? getCenterY(state) : HighPrecision();
+    HighPrecision cr = state.showJulia ? HighPrecision(state.juliaX) : getCenterX(state);
+    HighPrecision ci = state.showJulia ? HighPrecision(state.juliaY) : getCenterY(state);
+
+    orbit.zr.reserve(state.maxIterations + 1);
+    orbit.zi.reserve(state.maxIterations + 1);
+
+    for (int n = 0; ; n++) {
+        double zrValue = zr.toDouble();
+        double ziValue = zi.toDouble();
+        orbit.zr.push_back(zrValue);
+        orbit.zi.push_back(ziValue);
+        if (n == state.maxIterations || zrValue * zrValue + ziValue * ziValue >= ESCAPE_RADIUS_SQUARED) break;
+
+        HighPrecision zr2 = multiply(zr, zr, limbs);
+        HighPrecision zi2 = multiply(zi, zi, limbs);
+        HighPrecision zrzi = multiply(zr, zi, limbs);
+        if (state.fractalType != FRACTAL_MANDELBROT && zrzi.isNegative()) zrzi = -zrzi;
+        zi = zrzi + zrzi + ci;
+        zr = zr2 - zi2 + cr;
+    }
+
+    prepareApproximations(orbit, state);
+    return orbit;
+}
+
+void prepareApproximations(ReferenceOrbit& orbit, const RenderState& state) {
+    orbit.approximations.clear();
+    if (state.fractalType == FRACTAL_MANDELBROT && !state.stripes) {
+        // Julia pixels share c with the reference. Mandelbrot samples stay
+        // within the half diagonal; the margin covers anti-aliasing offsets.
+        double maxDelta = state.showJulia ? 0 :
+            std::hypot(state.getViewportWidth(), state.viewportHeight);
+        buildApproximations(orbit, maxDelta);
+    }
+}
+
+// |a + b| - |a| without the cancellation of computing it directly.
+inline double diffAbs(double a, double b) {
+    if (a >= 0) return (a + b >= 0) ? b : -(2 * a + b);
+    return (a + b > 0) ? 2 * a + b : -b;
+}
+
+// Perturbation: the pixel's orbit is the reference orbit Z plus a delta d,
+// and only d is iterated, as d' = 2Zd + d^2 + dc, which stays accurate in
+// double long after z itself would have run out of digits. Burning Ship
+// uses diffAbs for the |xy| term. When z gets closer to zero than to the
+// reference, or the reference ends, d is rebased onto the reference's start
+// (z stays the same, Z restarts at iteration 0), which is what keeps the
+// result free of glitches.
+template <int Type, bool IsJulia, bool Stripes, bool InnerCalculation>
+ReturnInfo calculatePerturbation(const RenderState& state, const ReferenceOrbit& reference,
+    double deltaR, double deltaI, KernelCounters& counters) {
+    const double* referenceR = reference.zr.data();
+    const double* referenceI = reference.zi.data();
+    int last = static_cast<int>(reference.zr.size()) - 1;
+
+    double dr = IsJulia ? deltaR : 0;
+    double di = IsJulia ? deltaI : 0;
+    double dcr = IsJulia ? 0 : deltaR;
+    double dci = IsJulia ? 0 : deltaI;
+
+    double zr = referenceR[0] + dr;
+    double zi = referenceI[0] + di;
+    double zr2 = zr * zr;
+    double zi2 = zi * zi;
+    int wholeFrequency = getWholeStripeFrequency(state.stripeFrequency);
+    double stripeSum = 0;
+    double stripe = 0;
+    int m = 0;
+    int i = 0;
+    int executed = 0;
+
+    ReturnInfo iterationInfo;
+
+    while (zr2 + zi2 < ESCAPE_RADIUS_SQUARED) {
+        executed++;
+        if (m == last || zr2 + zi2 < dr * dr + di * di) {
+            dr = zr - referenceR[0];
+            di = zi - referenceI[0];
+            m = 0;
+            counters.rebases++;
+        }
+
+        int steps = 1;
+        const ApproximationStep* approximation = nullptr;
+        if constexpr (Type == FRACTAL_MANDELBROT && !Stripes) {
+            if (m > 0) {
+                approximation = findApproximation(reference, m, dr * dr + di * di, state.maxIterations - i, steps);
+            }
+        }
+
+        double xr = referenceR[m];
+        double xi = referenceI[m];
+        double nextDr;
+        double nextDi;
+        if (approximation) {
+            const ApproximationStep& step = *approximation;
+            nextDr = step.ar * dr - step.ai * di + step.br * dcr - step.bi * dci;
+            nextDi = step.ar * di + step.ai * dr + step.br * dci + step.bi * dcr;
+            counters.skippedIterations += steps;
+        }
+        else if constexpr (Type == FRACTAL_MANDELBROT) {
+            nextDr = 2 * (xr * dr - xi * di) + dr * dr - di * di + dcr;
+            nextDi = 2 * (xr * di + xi * dr + dr * di) + dci;
+        }
+        else {
+            nextDr = 2 * (xr * dr - xi * di) + dr * dr - di * di + dcr;
+            nextDi = 2 * diffAbs(xr * xi, xr * di + xi * dr + dr * di) + dci;
+        }
+        dr = nextDr;
+        di = nextDi;
+        m += steps;
+
+        zr = referenceR[m] + dr;
+        zi = referenceI[m] + di;
+        zr2 = zr * zr;
+        zi2 = zi * zi;
+        // Stripe frames take no approximation steps, so every term is counted.
+        if constexpr (Stripes) {
+            stripe = getStripeTerm(zr, zi, zr2, zi2, state.stripeFrequency, wholeFrequency);
+            stripeSum += stripe;
+        }
+        i += steps;
+        if (i == state.maxIterations) {
+            if constexpr (InnerCalculation) {
+                break;
+            }
+            else {
+                counters.executedIterations += executed;
+                iterationInfo.iteration = -1;
+                return iterationInfo;
+            }
+        }
+    }
+
+    counters.executedIterations += executed;
+    iterationInfo.iteration = i;
+    iterationInfo.smoothIteration = i + 1 - log(log(zr2 + zi2) / 2) / log(2);
+    iterationInfo.stripeAverage = Stripes ? getStripeAverage(stripeSum, stripe, i, zr2 + zi2) : 0;
+    return iterationInfo;
+}
+
+template <int Type, bool IsJulia, bool Stripes, bool InnerCalculation>
+FractalKernels makeKernels(Precision precision) {
+    FractalKernels kernels;
+    kernels.pixelKernel = &calculateFractal<Type, IsJulia, Stripes, InnerCalculation>;
+    kernels.rowKernel = &calculateFractalRowScalar<Type, IsJulia, Stripes, InnerCalculation>;
+    kernels.resumeKernel = &continueFractalRowScalar<Type, IsJulia, Stripes, InnerCalculation>;
+    kernels.perturbationKernel = &calculatePerturbation<Type, IsJulia, Stripes, InnerCalculation>;
+
+    // The stripe average needs atan2/sin on every iteration, so stripe frames
+    // stay on the scalar kernel. Off-grid samples keep the double pixel kernel
+    // whatever the precision: there are few of them.
+#if FRACTAL_X86_SIMD
+    if constexpr (!Stripes) {
+        bool single = precision == Precision::Float;
+        if (SIMD_LEVEL == SimdLevel::AVX512) {
+            kernels.rowKernel = single ? &calculateFractalRowAvx512Float<Type, IsJulia, InnerCalculation, false> :
+                &calculateFractalRowAvx512<Type, IsJulia, InnerCalculation, false>;
+            kernels.resumeKernel = single ? &calculateFractalRowAvx512Float<Type, IsJulia, InnerCalculation, true> :
+                &calculateFractalRowAvx512<Type, IsJulia, InnerCalculation, true>;
+        }
+        else if (SIMD_LEVEL == SimdLevel::AVX2) {
+            kernels.rowKernel = single ? &calculateFractalRowAvx2Float<Type, IsJulia, InnerCalculation, false> :
+                &calculateFractalRowAvx2<Type, IsJulia, InnerCalculation, false>;
+            kernels.resumeKernel = single ? &calculateFractalRowAvx2Float<Type, IsJulia, InnerCalculation, true> :
+                &calculateFractalRowAvx2<Type, IsJulia, InnerCalculation, true>;
+        }
+    }
+#endif
+
+    return kernels;
+}
+
+template <int Type, bool IsJulia, bool Stripes>
+FractalKernels selectKernels(const RenderState& state, Precision precision) {
+    return state.innerCalculation ? makeKernels<Type, IsJulia, Stripes, true>(precision) :
+        makeKernels<Type, IsJulia, Stripes, false>(precision);
+}
+
+template <int Type, bool IsJulia>
+FractalKernels selectKernels(const RenderState& state, Precision precision) {
+    return state.stripes ? selectKernels<Type, IsJulia, true>(state, precision) :
+        selectKernels<Type, IsJulia, false>(state, precision);
+}
+
+template <int Type>
+FractalKernels selectKernels(const RenderState& state, Precision precision) {
+    return state.showJulia ? selectKernels<Type, true>(state, precision) : selectKernels<Type, false>(state, precision);
+}
+
+// `reference` is the orbit computed for `state` when usesPerturbation(state)
+// holds, and null otherwise. `height` is the render's height in pixels, which
+// sets the pixel size the precision is picked for.
+FractalKernels selectKernels(const RenderState& state, const ReferenceOrbit* reference, int height) {
+    Precision precision = selectPrecision(state, height);
+    FractalKernels kernels;
+    switch (state.fractalType) {
+    case FRACTAL_MANDELBROT: kernels = selectKernels<FRACTAL_MANDELBROT>(state, precision); break;
+    default: kernels = selectKernels<FRACTAL_BURNING_SHIP>(state, precision); break;
+    }
+
+    kernels.reference = reference;
+    if (!reference) {
+        kernels.centerX = state.viewportX;
+        kernels.centerY = state.viewportY;
+    }
+    return kernels;
+}
+
+HighPrecision::HighPrecision(double value) {
+    double magnitude = std::fabs(value);
+    double integer = std::floor(magnitude);
+    limbs.back() = static_cast<uint32_t>(integer);
+
+    // Each step only shifts bits of the double, so the conversion is exact.
+    double fraction = magnitude - integer;
+    for (int i = HIGH_PRECISION_LIMBS - 2; i >= 0 && fraction != 0; i--) {
+        fraction *= 4294967296.0;
+        double digit = std::floor(fraction);
+        limbs[i] = static_cast<uint32_t>(digit);
+        fraction -= digit;
+    }
+
+    if (value < 0) *this = -*this;
+}
+
+double HighPrecision::toDouble() const {
+    HighPrecision magnitude = isNegative() ? -*this : *this;
+
+    int top = HIGH_PRECISION_LIMBS - 1;
+    while (top > 0 && magnitude.limbs[top] == 0) top--;
+
+    // Three limbs cover the 53 bits of a double.
+    double value = 0;
+    for (int i = std::max(0, top - 2); i <= top; i++) {
+        value += std::ldexp(static_cast<double>(magnitude.limbs[i]), 32 * (i - (HIGH_PRECISION_LIMBS - 1)));
+    }
+    return isNegative() ? -value : value;
+}
+
+HighPrecision HighPrecision::operator-() const {
+    HighPrecision result;
+    uint64_t carry = 1;
+    for (int i = 0; i < HIGH_PRECISION_LIMBS; i++) {
+        uint64_t sum = static_cast<uint64_t>(~limbs[i]) + carry;
+        result.limbs[i] = static_cast<uint32_t>(sum);
+        carry = sum >> 32;
+    }
+    return result;
+}
+
+HighPrecision HighPrecision::operator+(const HighPrecision& other) const {
+    HighPrecision result;
+    uint64_t carry = 0;
+    for (int i = 0; i < HIGH_PRECISION_LIMBS; i++) {
+        uint64_t sum = static_cast<uint64_t>(limbs[i]) + other.limbs[i] + carry;
+        result.limbs[i] = static_cast<uint32_t>(sum);
+        carry = sum >> 32;
+    }
+    return result;
+}
+
+bool parseHighPrecision(const std::string& text, HighPrecision& value) {
+    size_t start = (!text.empty() && (text[0] == '-' || text[0] == '+')) ? 1 : 0;
+    size_t point = text.find('.', start);
+    std::string integerDigits = text.substr(start, point == std::string::npos ? std::string::npos : point - start);
+    std::string fractionDigits = (point == std::string::npos) ? "" : text.substr(point + 1);
+
+    if (integerDigits.empty() && fractionDigits.empty()) return false;
+    if (integerDigits.size() > 9) return false;
+    for (char c : integerDigits + fractionDigits) {
+        if (c < '0' || c > '9') return false;
+    }
+
+    // Horner from the last digit: fraction = (digit + fraction) / 10.
+    HighPrecision result;
+    for (auto it = fractionDigits.rbegin(); it != fractionDigits.rend(); ++it) {
+        result.limbs.back() += *it - '0';
+        uint64_t remainder = 0;
+        for (int i = HIGH_PRECISION_LIMBS - 1; i >= 0; i--) {
+            uint64_t current = (remainder << 32) | result.limbs[i];
+            result.limbs[i] = static_cast<uint32_t>(current / 10);
+            remainder = current % 10;
+        }
+    }
+    result.limbs.back() = integerDigits.empty() ? 0 : static_cast<uint32_t>(std::stoul(integerDigits));
+
+    value = (text[0] == '-') ? -result : result;
+    return true;
+}
+
+std::string formatHighPrecision(const HighPrecision& value, int fractionDigits) {
+    HighPrecision magnitude = value.isNegative() ? -value : value;
+    HighPrecision half;
+    if (parseHighPrecision("0." + std::string(fractionDigits, '0') + "5", half)) magnitude = magnitude + half;
+
+    std::string text = (value.isNegative() ? "-" : "") + std::to_string(magnitude.limbs.back());
+    if (fractionDigits > 0) text += '.';
+    for (int digit = 0; digit < fractionDigits; digit++) {
+        uint64_t carry = 0;
+        for (int i = 0; i < HIGH_PRECISION_LIMBS - 1; i++) {
+            uint64_t product = static_cast<uint64_t>(magnitude.limbs[i]) * 10 + carry;
+            magnitude.limbs[i] = static_cast<uint32_t>(product);
+            carry = product >> 32;
+        }
+        text += static_cast<char>('0' + carry);
+    }
+
+    // Trailing zeros carry no information.
+    if (fractionDigits > 0) {
+        size_t last = text.find_last_not_of('0');
+        text.erase(text[last] == '.' ? last + 2 : last + 1);
+    }
+    return text;
+}
+
+HighPrecision multiply(const HighPrecision& a, const HighPrecision& b, int fractionLimbs) {
+    constexpr int FRACTION = HIGH_PRECISION_LIMBS - 1;
+    HighPrecision x = a.isNegative() ? -a : a;
+    HighPrecision y = b.isNegative() ? -b : b;
+
+    // Limb i + j of the double-width product lands on result limb i + j - FRACTION.
+    // Columns below the result's last limb, bar one guard column, are dropped.
+    int lowest = FRACTION - fractionLimbs;
+    int firstColumn = lowest + FRACTION - 1;
+    uint64_t columns[2 * HIGH_PRECISION_LIMBS] = {};
+    for (int i = lowest; i < HIGH_PRECISION_LIMBS; i++) {
+        if (x.limbs[i] == 0) continue;
+        for (int j = std::max(lowest, firstColumn - i); j < HIGH_PRECISION_LIMBS; j++) {
+            uint64_t product = static_cast<uint64_t>(x.limbs[i]) * y.limbs[j];
+            columns[i + j] += product & 0xFFFFFFFFu;
+            columns[i + j + 1] += product >> 32;
+        }
+    }
+
+    HighPrecision result;
+    uint64_t carry = 0;
+    for (int k = firstColumn; k < FRACTION + HIGH_PRECISION_LIMBS; k++) {
+        uint64_t sum = columns[k] + carry;
+        if (k - FRACTION >= lowest) result.limbs[k - FRACTION] = static_cast<uint32_t>(sum);
+        carry = sum >> 32;
+    }
+
+    return (a.isNegative() != b.isNegative()) ? -result : result;
+}
+
+AntiAliasingScratch::AntiAliasingScratch()
+    : centers((RENDER_TILE_SIZE + 2) * (RENDER_TILE_SIZE + 2)),
+    colors(centers.size()),
+    computed(centers.size()),
+    edgeColumns(RENDER_TILE_SIZE),
+    sampleColumns(RENDER_TILE_SIZE * MAX_ANTI_ALIASING_SAMPLES),
+    samples(sampleColumns.size()),
+    sums(RENDER_TILE_SIZE * 3) {
+}
+
+RenderTile expandTile(const RenderTile& tile, int margin, int width, int height) {
+    return {
+        std::max(0, tile.startX - margin), std::max(0, tile.startY - margin),
+        std::min(width, tile.endX + margin), std::min(height, tile.endY + margin)
+    };
+}
+
+// `a` and `b` are iteration counts.
+inline bool isEdgeBetween(int a, const sf::Color& colorA, int b, const sf::Color& colorB) {
+    if ((a == -1) != (b == -1)) return true;
+    return std::abs(colorA.r - colorB.r) > ANTI_ALIASING_THRESHOLD ||
+        std::abs(colorA.g - colorB.g) > ANTI_ALIASING_THRESHOLD ||
+        std::abs(colorA.b - colorB.b) > ANTI_ALIASING_THRESHOLD;
+}
+
+void refineEdges(sf::Uint8* pixels, int stride, sf::Uint8* refined, const RenderState& state,
+    const Coloring& coloring, const FractalKernels& kernels, const RenderTile& tile, const RenderTile& area,
+    int width, int height, AntiAliasingScratch& scratch, KernelCounters& counters) {
+    int samples = std::min(state.antiAliasingSamples, MAX_ANTI_ALIASING_SAMPLES);
+    if (samples < 2) return;
+
+    double pixelHeight = state.viewportHeight / height;
+    double pixelWidth = state.getViewportWidth() / width;
+    double halfHeight = state.viewportHeight / 2;
+    double halfWidth = state.getViewportWidth() / 2;
+
+    int areaStride = area.endX - area.startX;
+    int areaSize = areaStride * (area.endY - area.startY);
+    for (int i = 0; i < areaSize; i++) {
+        scratch.colors[i] = coloring.getColor(scratch.centers.get(i));
+    }
+
+    // Samples sit on an even grid around the pixel's own sample, which is
+    // one of them when the count is odd.
+    double sampleWidth = pixelWidth / samples;
+    double sampleOriginX = kernels.centerX - halfWidth - (samples - 1) * 0.5 * sampleWidth;
+    int middle = (samples % 2 == 1) ? samples / 2 : -1;
+
+    for (int y = tile.startY; y < tile.endY; y++) {
+        const int* centers = scratch.centers.iterations.data() + (y - area.startY) * areaStride - area.startX;
+        const sf::Color* colors = scratch.colors.data() + (y - area.startY) * areaStride - area.startX;
+        int rowStart = (y - tile.startY) * stride - tile.startX;
+
+        int edgeCount = 0;
+        for (int x = tile.startX; x < tile.endX; x++) {
+            if (refined && refined[rowStart + x]) continue;
+            int up = x - areaStride;
+            int down = x + areaStride;
+            bool edge =
+                (x > area.startX && isEdgeBetween(centers[x], colors[x], centers[x - 1], colors[x - 1])) ||
+                (x + 1 < area.endX && isEdgeBetween(centers[x], colors[x], centers[x + 1], colors[x + 1])) ||
+                (y > area.startY && isEdgeBetween(centers[x], colors[x], centers[up], colors[up])) ||
+                (y + 1 < area.endY && isEdgeBetween(centers[x], colors[x], centers[down], colors[down]));
+            if (edge) scratch.edgeColumns[edgeCount++] = x;
+        }
+        if (edgeCount == 0) continue;
+
+        std::fill(scratch.sums.begin(), scratch.sums.begin() + edgeCount * 3, 0);
+        if (middle >= 0) {
+            for (int k = 0; k < edgeCount; k++) {
+                const sf::Color& color = colors[scratch.edgeColumns[k]];
+                scratch.sums[k * 3] += color.r;
+                scratch.sums[k * 3 + 1] += color.g;
+                scratch.sums[k * 3 + 2] += color.b;
+            }
+        }
+
+        for (int sy = 0; sy < samples; sy++) {
+            double ci = kernels.centerY - halfHeight + (y + (sy - (samples - 1) * 0.5) / samples) * pixelHeight;
+
+            int count = 0;
+            for (int k = 0; k < edgeCount; k++) {
+                for (int sx = 0; sx < samples; sx++) {
+                    if (sy == middle && sx == middle) continue;
+                    scratch.sampleColumns[count++] = scratch.edgeColumns[k] * samples + sx;
+                }
+            }
+            kernels.row(state, sampleOriginX, sampleWidth, ci, scratch.sampleColumns.data(), count,
+                scratch.samples.data(), nullptr, counters);
+
+            int perPixel = count / edgeCount;
+            for (int j = 0; j < count; j++) {
+                sf::Color color = coloring.getColor(scratch.samples[j]);
+                int* sum = scratch.sums.data() + (j / perPixel) * 3;
+                sum[0] += color.r;
+                sum[1] += color.g;
+                sum[2] += color.b;
+            }
+        }
+
+        int sampleCount = samples * samples;
+        for (int k = 0; k < edgeCount; k++) {
+            int index = rowStart + scratch.edgeColumns[k];
+            const int* sum = scratch.sums.data() + k * 3;
+            writePixel(pixels, index * 4, sf::Color(
+                static_cast<sf::Uint8>(sum[0] / sampleCount),
+                static_cast<sf::Uint8>(sum[1] / sampleCount),
+                static_cast<sf::Uint8>(sum[2] / sampleCount)));
+            if (refined) refined[index] = 1;
+        }
+    }
+}
+
+RenderThreadPool::RenderThreadPool(int threadCount) {
+    threadCount = std::max(1, threadCount);
+    busyTimes.assign(threadCount, 0.0);
+    finishedWorkers = threadCount;
+
+    for (int i = 0; i < threadCount; i++) {
+        workers.push_back(std::make_unique<Worker>());
+    }
+    for (int i = 0; i < threadCount; i++) {
+        workers[i]->thread = std::thread(&RenderThreadPool::workerLoop, this, i);
+    }
+}
+
+RenderThreadPool::~RenderThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(poolMutex);
+        stopping = true;
+    }
+    workAvailable.notify_all();
+
+    for (auto& worker : workers) {
+        worker->thread.join();
+    }
+}
+
+void RenderThreadPool::submit(const std::vector<RenderTile>& tiles, TileFunction function) {
+    wait();
+    if (tiles.empty()) return;
+
+    int threadCount = getThreadCount();
+    for (int i = 0; i < threadCount; i++) {
+        std::lock_guard<std::mutex> lock(workers[i]->queueMutex);
+        workers[i]->queue.clear();
+        workers[i]->queueFront = 0;
+        workers[i]->busyTime = 0;
+    }
+    for (size_t i = 0; i < tiles.size(); i++) {
+        Worker& worker = *workers[i % threadCount];
+        std::lock_guard<std::mutex> lock(worker.queueMutex);
+        worker.queue.push_back(tiles[i]);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(poolMutex);
+        currentFunction = std::move(function);
+        finishedWorkers = 0;
+        batchId++;
+    }
+    workAvailable.notify_all();
+}
+
+void RenderThreadPool::cancel() {
+    for (auto& worker : workers) {
+        std::lock_guard<std::mutex> lock(worker->queueMutex);
+        worker->queue.clear();
+        worker->queueFront = 0;
+    }
+}
+
+void RenderThreadPool::wait() {
+    std::unique_lock<std::mutex> lock(poolMutex);
+    workFinished.wait(lock, [&] { return finishedWorkers == getThreadCount(); });
+}
+
+bool RenderThreadPool::isIdle() {
+    std::lock_guard<std::mutex> lock(poolMutex);
+    return finishedWorkers == getThreadCount();
+}
+
+void RenderThreadPool::run(const std::vector<RenderTile>& tiles, const TileFunction& function) {
+    submit(tiles, function);
+    wait();
+}
+
+void RenderThreadPool::getBusyTimes(std::vector<double>& times) {
+    std::lock_guard<std::mutex> lock(poolMutex);
+    times.assign(busyTimes.begin(), busyTimes.end());
+}
+
+double RenderThreadPool::getLongestBusyTime() {
+    std::lock_guard<std::mutex> lock(poolMutex);
+    return *std::max_element(busyTimes.begin(), busyTimes.end());
+}
+
+bool RenderThreadPool::popTile(int index, RenderTile& tile) {
+    {
+        Worker& own = *workers[index];
+        std::lock_guard<std::mutex> lock(own.queueMutex);
+        if (own.queueFront < own.queue.size()) {
+            tile = own.queue[own.queueFront++];
+            return true;
+        }
+    }
+
+    int threadCount = getThreadCount();
+    for (int offset = 1; offset < threadCount; offset++) {
+        Worker& victim = *workers[(index + offset) % threadCount];
+        std::lock_guard<std::mutex> lock(victim.queueMutex);
+        if (victim.queueFront < victim.queue.size()) {
+            tile = victim.queue.back();
+            victim.queue.pop_back();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void RenderThreadPool::workerLoop(int index) {
+    unsigned long long seenBatch = 0;
+
+    while (true) {
+        const TileFunction* function;
+        {
+            std::unique_lock<std::mutex> lock(poolMutex);
+            workAvailable.wait(lock, [&] { return stopping || batchId != seenBatch; });
+            if (stopping) return;
+            seenBatch = batchId;
+            function = &currentFunction;
+        }
+
+        Worker& worker = *workers[index];
+        RenderTile tile;
+        while (popTile(index, tile)) {
+            auto start = std::chrono::high_resolution_clock::now();
+            (*function)(tile, index);
+            auto end = std::chrono::high_resolution_clock::now();
+            worker.busyTime += std::chrono::duration<double, std::milli>(end - start).count();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(poolMutex);
+            finishedWorkers++;
+            if (finishedWorkers == getThreadCount()) {
+                for (int i = 0; i < getThreadCount(); i++) {
+                    busyTimes[i] = workers[i]->busyTime;
+                }
+            }
+        }
+        workFinished.notify_all();
+    }
+}
+
+std::vector<RenderTile> makeTiles(int width, int height, int tileSize) {
+    std::vector<RenderTile> tiles;
+    makeTiles(width, height, tileSize, tiles);
+    return tiles;
+}
+
+void makeTiles(int width, int height, int tileSize, std::vector<RenderTile>& tiles) {
+    tiles.clear();
+    tiles.reserve(((width + tileSize - 1) / tileSize) * ((height + tileSize - 1) / tileSize));
+
+    for (int y = 0; y < height; y += tileSize) {
+        for (int x = 0; x < width; x += tileSize) {
+            tiles.push_back({ x, y, std::min(x + tileSize, width), std::min(y + tileSize, height) });
+        }
+    }
+}
+
+BandRenderer::BandRenderer(RenderThreadPool& pool, const RenderState& state, int width, int height,
+    std::unique_ptr<ReferenceOrbit> preparedReference)
+    : pool(pool), state(state), width(width), height(height), scratch(pool.getThreadCount()),
+    counters(pool.getThreadCount()), coloring(state) {
+    if (usesPerturbation(state)) {
+        reference = preparedReference ? std::move(preparedReference) :
+            std::make_unique<ReferenceOrbit>(computeReferenceOrbit(state));
+    }
+    kernels = std::make_unique<FractalKernels>(selectKernels(state, reference.get(), height));
+    if (usesHistogramColoring(state)) coloring = Coloring(state, sampleEqualization());
+}
+
+BandRenderer::~BandRenderer() = default;
+
+// The grid only depends on the image size, so every band, and every worker
+// of a distributed export, colors with the same histogram.
+std::shared_ptr<const std::vector<float>> BandRenderer::sampleEqualization() {
+    int step = std::max(1, std::max(width, height) / HISTOGRAM_SAMPLE_SIZE);
+    double pixelHeight = state.viewportHeight / height;
+    double pixelWidth = state.getViewportWidth() / width;
+    double originX = kernels->centerX - state.getViewportWidth() / 2;
+    double originY = kernels->centerY - state.viewportHeight / 2;
+
+    IterationHistogram histogram;
+    histogram.reset(pool.getThreadCount(), state.maxIterations);
+    std::vector<RenderTile> tiles = makeTiles((width + step - 1) / step, (height + step - 1) / step, RENDER_TILE_SIZE);
+    pool.run(tiles, [&](const RenderTile& tile, int threadIndex) {
+        int columns[RENDER_TILE_SIZE];
+        ReturnInfo rowInfo[RENDER_TILE_SIZE];
+        int count = tile.endX - tile.startX;
+        for (int k = 0; k < count; k++) columns[k] = (tile.startX + k) * step;
+
+        for (int y = tile.startY; y < tile.endY; y++) {
+            kernels->row(state, originX, pixelWidth, originY + y * step * pixelHeight, columns, count, rowInfo,
+                nullptr, counters[threadIndex]);
+            for (int k = 0; k < count; k++) {
+                histogram.add(threadIndex, rowInfo[k].iteration, rowInfo[k].smoothIteration);
+            }
+        }
+    });
+    return histogram.getEqualization();
+}
+
+void BandRenderer::render(int startY, int endY, sf::Uint8* pixels) {
+    std::vector<RenderTile> tiles = makeTiles(width, endY - startY, RENDER_TILE_SIZE);
+    for (RenderTile& tile : tiles) {
+        tile.startY += startY;
+        tile.endY += startY;
+    }
+
+    pool.run(tiles, [&](const RenderTile& tile, int threadIndex) {
+        renderFractalRegion(pixels, startY, state, coloring, *kernels, tile, width, height, scratch[threadIndex],
+            counters[threadIndex]);
+    });
+}
+
+KernelCounters BandRenderer::getCounters() const {
+    KernelCounters total;
+    for (const KernelCounters& workerCounters : counters) total.add(workerCounters);
+    return total;
+}
+
+void renderFractal(RenderThreadPool& pool, sf::Uint8* pixels, const RenderState& state, int width, int height) {
+    BandRenderer(pool, state, width, height).render(0, height, pixels);
+}
+
+// Appends printf-style through a stack buffer; lines longer than it are cut.
+template <typename... Args>
+void appendFormatted(std::string& text, const char* format, Args... args) {
+    char buffer[512];
+    int length = std::snprintf(buffer, sizeof(buffer), format, args...);
+    if (length > 0) text.append(buffer, std::min(static_cast<size_t>(length), sizeof(buffer) - 1));
+}
+
+// The overlay's lines are written over strings the window keeps, so they
+// reuse their storage from frame to frame. `busyTimes` is scratch space.
+void writeBusyTimeString(std::string& text, RenderThreadPool& pool, std::vector<double>& busyTimes) {
+    pool.getBusyTimes(busyTimes);
+    double minBusy = *std::min_element(busyTimes.begin(), busyTimes.end());
+    double maxBusy = *std::max_element(busyTimes.begin(), busyTimes.end());
+    double totalBusy = 0;
+    for (double busy : busyTimes) totalBusy += busy;
+
+    text.clear();
+    appendFormatted(text, "Busy (%d threads): min %.1f / avg %.1f / max %.1fms", static_cast<int>(busyTimes.size()),
+        minBusy, totalBusy / busyTimes.size(), maxBusy);
+}
+
+void writeCounterString(std::string& text, const KernelCounters& counters) {
+    text.clear();
+    appendFormatted(text, "Periodicity exits: %lld", counters.periodicityExits);
+    if (counters.rebases > 0) appendFormatted(text, "   Rebases: %lld", counters.rebases);
+    if (counters.skippedIterations > 0) appendFormatted(text, "   Skipped: %lld", counters.skippedIterations);
+    if (counters.cachedPixels > 0) appendFormatted(text, "   Cached: %lld", counters.cachedPixels);
+}
+
+// Blue for the cheapest tiles through green and yellow to red for the
+// dearest, translucent so the fractal shows through.
+sf::Color getHeatColor(double cost) {
+    static const sf::Color stops[] = {
+        sf::Color(0, 0, 255), sf::Color(0, 255, 0), sf::Color(255, 255, 0), sf::Color(255, 0, 0) };
+    double position = std::clamp(cost, 0.0, 1.0) * 3;
+    int index = std::min(2, static_cast<int>(position));
+    double t = position - index;
+    const sf::Color& a = stops[index];
+    const sf::Color& b = stops[index + 1];
+    return sf::Color(static_cast<sf::Uint8>(a.r + (b.r - a.r) * t), static_cast<sf::Uint8>(a.g + (b.g - a.g) * t),
+        static_cast<sf::Uint8>(a.b + (b.b - a.b) * t), 140);
+}
+
+// One texel per tile, colored by its time per pixel relative to the dearest
+// tile, drawn scaled up by RENDER_TILE_SIZE over the frame. The costs and
+// texels are kept from one update to the next.
+class TileHeatmap {
+public:
+    void update(const AsyncRenderer& renderer, int width, int height);
+    const sf::Sprite& getSprite() const { return sprite; }
+
+private:
+    sf::Texture texture;
+    sf::Sprite sprite;
+    std::vector<double> costs;
+    std::vector<sf::Uint8> pixels;
+};
+
+void TileHeatmap::update(const AsyncRenderer& renderer, int width, int height) {
+    const std::vector<RenderStats>& stats = renderer.getTileStats();
+    int across = renderer.getTilesAcross();
+    if (stats.empty()) return;
+    int down = static_cast<int>(stats.size()) / across;
+
+    costs.resize(stats.size());
+    double maxCost = 0;
+    for (size_t i = 0; i < stats.size(); i++) {
+        int x = static_cast<int>(i) % across;
+        int y = static_cast<int>(i) / across;
+        int tilePixels = (std::min(width, (x + 1) * RENDER_TILE_SIZE) - x * RENDER_TILE_SIZE) *
+            (std::min(height, (y + 1) * RENDER_TILE_SIZE) - y * RENDER_TILE_SIZE);
+        costs[i] = stats[i].milliseconds / tilePixels;
+        maxCost = std::max(maxCost, costs[i]);
+    }
+
+    pixels.resize(stats.size() * 4);
+    for (size_t i = 0; i < stats.size(); i++) {
+        sf::Color color = getHeatColor(maxCost > 0 ? costs[i] / maxCost : 0);
+        pixels[i * 4] = color.r;
+        pixels[i * 4 + 1] = color.g;
+        pixels[i * 4 + 2] = color.b;
+        pixels[i * 4 + 3] = color.a;
+    }
+    // A resized window changes the tile grid, and only then the texture.
+    sf::Vector2u size = texture.getSize();
+    if (static_cast<int>(size.x) != across || static_cast<int>(size.y) != down) {
+        texture.create(across, down);
+        sprite.setTexture(texture, true);
+        sprite.setScale(RENDER_TILE_SIZE, RENDER_TILE_SIZE);
+    }
+    texture.update(pixels.data());
+}
+
+// The heatmap's companion panel: the spread of tile times, where the
+// iterations went and how evenly the workers were loaded.
+std::string getRenderStatsString(const AsyncRenderer& renderer) {
+    std::vector<double> tileTimes;
+    for (const RenderStats& tile : renderer.getTileStats()) tileTimes.push_back(tile.milliseconds);
+    if (tileTimes.empty()) return "";
+    std::sort(tileTimes.begin(), tileTimes.end());
+
+    const KernelCounters& counters = renderer.getCounters();
+    const std::vector<RenderStats>& workers = renderer.getWorkerStats();
+    double busiest = 0;
+    double totalBusy = 0;
+    for (const RenderStats& worker : workers) {
+        busiest = std::max(busiest, worker.milliseconds);
+        totalBusy += worker.milliseconds;
+    }
+
+    std::stringstream ss;
+    ss << std::fixed << std::setprecision(2);
+    ss << "Tiles (" << RENDER_TILE_SIZE << "px): " << tileTimes.size() << "   ms min " << tileTimes.front()
+        << " / median " << tileTimes[tileTimes.size() / 2] << " / max " << tileTimes.back() << "\n";
+    ss << std::setprecision(1);
+    ss << "Executed iterations: " << counters.executedIterations / 1e6 << "M   Cardioid/bulb: "
+        << counters.cardioidSkips << "   Periodicity: " << counters.periodicityExits
+        << "   Filled: " << counters.filledPixels << "   Cached: " << counters.cachedPixels
+        << "   Uploaded: " << renderer.getUploadedPixels() / 1e6 << "M px\n";
+    ss << "Load balance: busiest worker " << busiest << "ms vs mean "
+        << (workers.empty() ? 0 : totalBusy / workers.size()) << "ms";
+    for (size_t i = 0; i < workers.size(); i++) {
+        ss << (i % 4 == 0 ? "\n" : "   ") << "T" << i << ": " << workers[i].milliseconds << "ms "
+            << workers[i].tiles << " tiles " << workers[i].counters.executedIterations / 1e6 << "M it";
+    }
+    return ss.str();
+}
+
+AsyncRenderer::AsyncRenderer(RenderThreadPool& pool, FrameBuffer& frame, TileCache* cache)
+    : pool(pool), frame(frame), cache(cache),
+    tiles(makeTiles(frame.width, frame.height, RENDER_TILE_SIZE)),
+    staging(frame.pixels.size()),
+    tilesAcross((frame.width + RENDER_TILE_SIZE - 1) / RENDER_TILE_SIZE),
+    tileStats(tiles.size()),
+    workerStats(pool.getThreadCount()),
+    workerScratch(pool.getThreadCount()) {
+    // A pass finishes each tile once between two drains.
+    finishedTiles.reserve(tiles.size());
+    drainedTiles.reserve(tiles.size());
+}
+
+AsyncRenderer::~AsyncRenderer() {
+    cancel();
+}
+
+void AsyncRenderer::start(const RenderState& state, RenderMode requestedMode) {
+    if (requestedMode == RenderMode::Recolor) {
+        // A job still iterating has colored part of the frame with the old
+        // palette, so it is restarted in its own mode with the new state.
+        if (busy && mode != RenderMode::Recolor) requestedMode = mode;
+        if (!frame.isComplete()) requestedMode = RenderMode::Full;
+    }
+    if (requestedMode != RenderMode::Recolor) equalizationCurrent = false;
+
+    cancel();
+
+    reuseIterationData(state);
+    // Recoloring repaints anti-aliased pixels from their single result.
+    if (recolorAll || requestedMode == RenderMode::Recolor) frame.clearRefined();
+
+    generation++;
+    snapshot = state;
+    mode = requestedMode;
+    updateKernels();
+    activeGeneration = generation;
+    busy = true;
+    startTime = std::chrono::high_resolution_clock::now();
+    pendingFirstPassTime = -1;
+    std::fill(tileStats.begin(), tileStats.end(), RenderStats());
+    std::fill(workerStats.begin(), workerStats.end(), RenderStats());
+    if (uploadWholeFrame) std::copy(frame.pixels.begin(), frame.pixels.end(), staging.begin());
+    uploadedPixels = 0;
+    coloring = Coloring(snapshot, equalization);
+    if (mode == RenderMode::Recolor) {
+        submitPass(usesHistogramColoring(snapshot) && !equalizationCurrent ? Pass::Histogram : Pass::Recolor, 1);
+    }
+    else if (mode == RenderMode::Progressive) {
+        firstDownscale = budget.getFirstDownscale(static_cast<long long>(frame.width) * frame.height);
+        submitPass(Pass::Iterate, firstDownscale);
+    }
+    else {
+        submitPass(Pass::Iterate, 1);
+    }
+}
+
+void AsyncRenderer::submitPass(Pass nextPass, int downscale) {
+    pass = nextPass;
+    passDownscale = downscale;
+    remainingTiles = static_cast<int>(tiles.size());
+    if (pass == Pass::Histogram) histogram.reset(pool.getThreadCount(), snapshot.maxIterations);
+
+    // Pixels computed before the job only need recoloring once, in its first pass.
+    passFirst = pendingFirstPassTime < 0;
+    passRecolor = recolorAll && passFirst;
+    // The pass is read from the members, which stay put until the pool is
+    // idle again, so the function fits std::function without a heap block.
+    pool.submit(tiles, [this](const RenderTile& tile, int threadIndex) {
+        if (pass == Pass::Refine) refineTile(tile, generation, threadIndex);
+        else if (pass == Pass::Histogram) countTile(tile, generation, threadIndex);
+        else renderTile(tile, generation, threadIndex, pass, passDownscale, passRecolor, passFirst);
+    });
+}
+
+// What the reference orbit of a deep zoom and its approximations depend on.
+bool hasSameReference(const RenderState& a, const RenderState& b) {
+    return a.viewportX == b.viewportX && a.viewportXLow == b.viewportXLow &&
+        a.viewportY == b.viewportY && a.viewportYLow == b.viewportYLow &&
+        a.viewportHeight == b.viewportHeight &&
+        a.aspectRatio == b.aspectRatio &&
+        a.maxIterations == b.maxIterations &&
+        a.showJulia == b.showJulia &&
+        a.juliaX == b.juliaX &&
+        a.juliaY == b.juliaY &&
+        a.fractalType == b.fractalType &&
+        a.stripes == b.stripes;
+}
+
+void AsyncRenderer::updateKernels() {
+    if (!usesPerturbation(snapshot)) {
+        reference.reset();
+    }
+    else if (!reference || !hasSameReference(referenceState, snapshot)) {
+        reference = std::make_unique<ReferenceOrbit>(computeReferenceOrbit(snapshot));
+        referenceState = snapshot;
+    }
+    // Every job picks its kernels; the object itself is kept.
+    if (kernels) *kernels = selectKernels(snapshot, reference.get(), frame.height);
+    else kernels = std::make_unique<FractalKernels>(selectKernels(snapshot, reference.get(), frame.height));
+}
+
+// Everything but the view and the iteration limit that feeds the escape-time
+// result of a point.
+bool hasSameFormula(const RenderState& a, const RenderState& b) {
+    return a.showJulia == b.showJulia &&
+        a.juliaX == b.juliaX &&
+        a.juliaY == b.juliaY &&
+        a.fractalType == b.fractalType &&
+        a.stripes == b.stripes &&
+        a.stripeFrequency == b.stripeFrequency &&
+        a.innerCalculation == b.innerCalculation &&
+        a.solidFill == b.solidFill;
+}
+
+bool hasSameColoring(const RenderState& a, const RenderState& b) {
+    return a.colorDensity == b.colorDensity &&
+        a.colorScheme == b.colorScheme &&
+        a.stripeIntensity == b.stripeIntensity &&
+        a.antiAliasing == b.antiAliasing &&
+        a.antiAliasingSamples == b.antiAliasingSamples &&
+        a.histogramColoring == b.histogramColoring;
+}
+
+// Rounds `value` to a whole number of pixels if it is one, up to rounding error.
+bool roundToWholePixels(double value, int limit, int& rounded) {
+    double nearest = std::round(value);
+    if (std::fabs(value - nearest) >= 1e-3 || std::fabs(nearest) >= limit) return false;
+    rounded = static_cast<int>(nearest);
+    return true;
+}
+
+void AsyncRenderer::reuseIterationData(const RenderState& state) {
+    bool reusable = hasDataState && hasSameFormula(dataState, state);
+
+    // Where the new frame's pixel (0, 0) sits, in pixels of the old frame.
+    double oldPixelWidth = dataState.getViewportWidth() / frame.width;
+    double oldPixelHeight = dataState.viewportHeight / frame.height;
+    double centerOffsetX = (getCenterX(state) - getCenterX(dataState)).toDouble();
+    double centerOffsetY = (getCenterY(state) - getCenterY(dataState)).toDouble();
+    double originX = (centerOffsetX - state.getViewportWidth() / 2 + dataState.getViewportWidth() / 2) / oldPixelWidth;
+    double originY = (centerOffsetY - state.viewportHeight / 2 + dataState.viewportHeight / 2) / oldPixelHeight;
+    // Wheel zooms scale the height by exactly 0.5 or 2.
+    double scale = state.viewportHeight / dataState.viewportHeight;
+    int baseX = 0;
+    int baseY = 0;
+
+    if (reusable && scale == 1) {
+        // Drags move the view by whole pixels; anything else lands between
+        // the old samples and can't be reused.
+        reusable = roundToWholePixels(originX, frame.width, baseX) &&
+            roundToWholePixels(originY, frame.height, baseY);
+        if (reusable && (baseX != 0 || baseY != 0)) {
+            frame.shift(baseX, baseY);
+            uploadWholeFrame = true;
+        }
+    }
+    else if (reusable && scale == 0.5) {
+        // Every other new pixel in each direction lands on an old sample as
+        // long as the view moved by whole new pixels.
+        reusable = roundToWholePixels(originX * 2, frame.width * 2, baseX) &&
+            roundToWholePixels(originY * 2, frame.height * 2, baseY);
+        if (reusable) {
+            frame.rescale(baseX, baseY, 1, 2);
+            frame.gridOriginX = -baseX;
+            frame.gridOriginY = -baseY;
+            uploadWholeFrame = true;
+        }
+    }
+    else if (reusable && scale == 2) {
+        // Every new pixel inside the old view lands on every other old sample.
+        reusable = roundToWholePixels(originX, frame.width * 2, baseX) &&
+            roundToWholePixels(originY, frame.height * 2, baseY);
+        if (reusable) {
+            frame.rescale(baseX, baseY, 2, 1);
+            frame.gridOriginX = 0;
+            frame.gridOriginY = 0;
+            uploadWholeFrame = true;
+        }
+    }
+    else {
+        reusable = false;
+    }
+
+    if (reusable && state.maxIterations != dataState.maxIterations) {
+        frame.applyLimit(state.maxIterations);
+        // Any sample of a refined pixel may have hit the old limit.
+        frame.clearRefined();
+    }
+
+    if (!reusable) {
+        frame.invalidate();
+    }
+
+    // A cancelled job may have left tiles in the old colors, so the flag is
+    // only cleared once a job completes.
+    if (!reusable || !hasSameColoring(dataState, state)) recolorAll = true;
+    dataState = state;
+    hasDataState = true;
+}
+
+void AsyncRenderer::cancel() {
+    activeGeneration = 0;
+    pool.cancel();
+    pool.wait();
+    busy = false;
+
+    std::lock_guard<std::mutex> lock(finishedMutex);
+    finishedTiles.clear();
+}
+
+void AsyncRenderer::resize(int width, int height) {
+    cancel();
+    frame = FrameBuffer(width, height);
+    tiles = makeTiles(width, height, RENDER_TILE_SIZE);
+    staging.assign(frame.pixels.size(), 0);
+    tilesAcross = (width + RENDER_TILE_SIZE - 1) / RENDER_TILE_SIZE;
+    tileStats.assign(tiles.size(), RenderStats());
+    jobTileStats.clear();
+    finishedTiles.reserve(tiles.size());
+    drainedTiles.reserve(tiles.size());
+    hasDataState = false;
+    recolorAll = true;
+    uploadWholeFrame = false;
+    equalizationCurrent = false;
+}
+
+void RenderBudget::addJob(const KernelCounters& counters, long long pixels, double milliseconds) {
+    if (counters.executedIterations <= 0 || pixels <= 0 || milliseconds <= 0) return;
+    double rate = static_cast<double>(counters.executedIterations) / milliseconds;
+    double perPixel = static_cast<double>(counters.executedIterations) / pixels;
+    // Half of every new measurement goes in, so one odd view doesn't swing
+    // the next first pass.
+    bool first = iterationsPerMillisecond == 0;
+    iterationsPerMillisecond = first ? rate : (iterationsPerMillisecond + rate) / 2;
+    iterationsPerPixel = first ? perPixel : (iterationsPerPixel + perPixel) / 2;
+}
+
+int RenderBudget::getFirstDownscale(long long pixels) const {
+    if (iterationsPerMillisecond == 0) return PROGRESSIVE_FIRST_DOWNSCALE;
+    double budgetMilliseconds = 1000.0 / TARGET_FPS;
+    int downscale = 1;
+    while (downscale < PROGRESSIVE_MAX_DOWNSCALE &&
+        pixels * iterationsPerPixel / (static_cast<double>(downscale) * downscale) / iterationsPerMillisecond >
+        budgetMilliseconds) {
+        downscale *= 2;
+    }
+    return downscale;
+}
+
+double RenderBudget::getFrameScale(long long pixels, double budgetMilliseconds) const {
+    if (iterationsPerMillisecond == 0) return 1.0 / ANIMATION_SCALE_STEPS;
+    double fullMilliseconds = pixels * iterationsPerPixel / iterationsPerMillisecond;
+    // The pixel count goes with the square of the side.
+    int steps = static_cast<int>(ANIMATION_SCALE_STEPS * std::sqrt(budgetMilliseconds / fullMilliseconds));
+    return std::clamp(steps, 1, ANIMATION_SCALE_STEPS) / static_cast<double>(ANIMATION_SCALE_STEPS);
+}
+
+void AsyncRenderer::renderTile(const RenderTile& tile, unsigned long long jobGeneration, int threadIndex,
+    Pass tilePass, int downscale, bool recolor, bool firstPass) {
+    auto start = std::chrono::high_resolution_clock::now();
+    KernelCounters counters;
+    // Only pending pixels change unless the pass recolors.
+    RenderTile changed = (recolor || tilePass == Pass::Recolor) ? tile : frame.findRows(frame.computed, 0, tile);
+    // Cached results go in before the first pass samples anything.
+    if (cache && firstPass && tilePass == Pass::Iterate) {
+        counters.cachedPixels = cache->fill(frame, snapshot, coloring, tile);
+    }
+    // Each band of `downscale` rows holds one row of samples.
+    int rowStep = downscale;
+    // Subdivision needs the whole tile at once, which costs row-level cancellation.
+    if (tilePass == Pass::Iterate && downscale == 1 && usesSolidFill(snapshot)) rowStep = tile.endY - tile.startY;
+
+    for (int y = tile.startY; y < tile.endY; y += rowStep) {
+        if (activeGeneration != jobGeneration) return;
+
+        RenderTile rows = { tile.startX, y, tile.endX, std::min(y + rowStep, tile.endY) };
+        if (tilePass == Pass::Recolor) {
+            colorizeRegion(frame, coloring, rows);
+        }
+        else if (downscale > 1) {
+            renderCoarsePass(frame, snapshot, coloring, *kernels, rows, downscale, recolor, counters);
+        }
+        else {
+            renderPendingRegion(frame, snapshot, coloring, *kernels, rows, recolor, counters);
+        }
+    }
+    recordTile(tile, threadIndex, start, counters);
+
+    if (changed.startY < changed.endY) {
+        std::lock_guard<std::mutex> lock(finishedMutex);
+        finishedTiles.push_back({ jobGeneration, changed });
+    }
+    remainingTiles--;
+}
+
+void AsyncRenderer::refineTile(const RenderTile& tile, unsigned long long jobGeneration, int threadIndex) {
+    if (activeGeneration != jobGeneration) return;
+    auto start = std::chrono::high_resolution_clock::now();
+    KernelCounters counters;
+
+    // Every result is final by now, so the ring is read straight from the
+    // neighbouring tiles.
+    AntiAliasingScratch& scratch = workerScratch[threadIndex];
+    RenderTile area = expandTile(tile, 1, frame.width, frame.height);
+    int next = 0;
+    for (int y = area.startY; y < area.endY; y++) {
+        for (int x = area.startX; x < area.endX; x++) {
+            scratch.centers.set(next++, frame.results.get(frame.index(x, y)));
+        }
+    }
+    int first = frame.index(tile.startX, tile.startY);
+    refineEdges(frame.pixels.data() + first * 4, frame.getTileWidth(tile.startX), frame.refined.data() + first,
+        snapshot, coloring, *kernels, tile, area, frame.width, frame.height, scratch, counters);
+    recordTile(tile, threadIndex, start, counters);
+
+    // Rows refined by an earlier job go up again; tiles without an edge don't.
+    RenderTile changed = frame.findRows(frame.refined, 1, tile);
+    if (changed.startY < changed.endY) {
+        std::lock_guard<std::mutex> lock(finishedMutex);
+        finishedTiles.push_back({ jobGeneration, changed });
+    }
+    remainingTiles--;
+}
+
+void AsyncRenderer::countTile(const RenderTile& tile, unsigned long long jobGeneration, int threadIndex) {
+    if (activeGeneration != jobGeneration) return;
+    auto start = std::chrono::high_resolution_clock::now();
+
+    // Each tile of the frame is one contiguous block of the planes.
+    int first = frame.index(tile.startX, tile.startY);
+    int count = (tile.endX - tile.startX) * (tile.endY - tile.startY);
+    const int* iterations = frame.results.iterations.data() + first;
+    const double* smoothIterations = frame.results.smoothIterations.data() + first;
+    for (int i = 0; i < count; i++) histogram.add(threadIndex, iterations[i], smoothIterations[i]);
+    recordTile(tile, threadIndex, start, KernelCounters());
+    remainingTiles--;
+}
+
+void AsyncRenderer::recordTile(const RenderTile& tile, int threadIndex,
+    std::chrono::high_resolution_clock::time_point start, const KernelCounters& counters) {
+    double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    int index = (tile.startY / RENDER_TILE_SIZE) * tilesAcross + tile.startX / RENDER_TILE_SIZE;
+    tileStats[index].add(milliseconds, counters);
+    workerStats[threadIndex].add(milliseconds, counters);
+}
+
+bool AsyncRenderer::finishTiles(sf::Texture* texture) {
+    // Read the counter before draining so the last tile is never missed.
+    bool completed = busy && remainingTiles == 0;
+
+    drainedTiles.clear();
+    {
+        std::lock_guard<std::mutex> lock(finishedMutex);
+        drainedTiles.swap(finishedTiles);
+    }
+
+    // Whole rows of one tile are one contiguous RGBA block of a plane.
+    auto uploadRows = [&](const sf::Uint8* plane, const RenderTile& rows) {
+        if (!texture) return;
+        texture->update(plane + frame.index(rows.startX, rows.startY) * 4, rows.endX - rows.startX,
+            rows.endY - rows.startY, rows.startX, rows.startY);
+        uploadedPixels += static_cast<long long>(rows.endX - rows.startX) * (rows.endY - rows.startY);
+    };
+
+    if (uploadWholeFrame) {
+        // The shifted frame is on screen right away; pending strips are black
+        // until their tiles arrive.
+        for (const RenderTile& tile : tiles) uploadRows(staging.data(), tile);
+        uploadWholeFrame = false;
+    }
+
+    for (const FinishedTile& finished : drainedTiles) {
+        if (finished.generation == generation) uploadRows(frame.pixels.data(), finished.rows);
+    }
+
+    if (completed) {
+        pool.wait();
+        auto endTime = std::chrono::high_resolution_clock::now();
+        long long elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(endTime - startTime).count();
+        if (pendingFirstPassTime < 0) pendingFirstPassTime = elapsed;
+
+        if (pass == Pass::Iterate && passDownscale > 1) {
+            submitPass(Pass::Iterate, passDownscale / 2);
+            return false;
+        }
+        if (pass == Pass::Iterate && usesHistogramColoring(snapshot)) {
+            submitPass(Pass::Histogram, 1);
+            return false;
+        }
+        if (pass == Pass::Histogram) {
+            // Dropping the old shares first lets the histogram refill them.
+            coloring = Coloring(snapshot);
+            equalization.reset();
+            equalization = histogram.getEqualization();
+            equalizationCurrent = true;
+            coloring = Coloring(snapshot, equalization);
+            // Anti-aliased pixels averaged the colors of the histogram before.
+            frame.clearRefined();
+            submitPass(Pass::Recolor, 1);
+            return false;
+        }
+        if (pass != Pass::Refine && snapshot.antiAliasing) {
+            submitPass(Pass::Refine, 1);
+            return false;
+        }
+
+        busy = false;
+        recolorAll = false;
+        if (cache && mode != RenderMode::Recolor) cache->store(frame, snapshot);
+        jobCounters = KernelCounters();
+        for (const RenderStats& worker : workerStats) jobCounters.add(worker.counters);
+        jobTileStats = tileStats;
+        jobWorkerStats = workerStats;
+        jobUploadedPixels = uploadedPixels;
+        // Progressive jobs iterate most of the frame, which is what the
+        // budget's iterations per pixel describe.
+        if (mode == RenderMode::Progressive) {
+            budget.addJob(jobCounters, static_cast<long long>(frame.width) * frame.height, elapsed);
+        }
+        renderTime = elapsed;
+        firstPassTime = pendingFirstPassTime;
+    }
+
+    return completed;
+}
+
+SeedAnimator::SeedAnimator(RenderThreadPool& pool)
+    : pool(pool), scratch(pool.getThreadCount()), counters(pool.getThreadCount()) {
+}
+
+SeedAnimator::~SeedAnimator() {
+    cancel();
+}
+
+void SeedAnimator::start(const RenderState& state, int width, int height) {
+    double scale = budget.getFrameScale(static_cast<long long>(width) * height,
+        ANIMATION_BUDGET_SHARE * 1000.0 / TARGET_FPS);
+    backWidth = std::max(1, static_cast<int>(std::lround(width * scale)));
+    backHeight = std::max(1, static_cast<int>(std::lround(height * scale)));
+    backPixels.resize(static_cast<size_t>(backWidth) * backHeight * 4);
+
+    // Edges are left to the full-quality frame once the seed stops, and
+    // histogram coloring, which needs the frame's results first, falls back
+    // to coloring by iteration count.
+    snapshot = state;
+    snapshot.antiAliasing = false;
+    if (!usesPerturbation(snapshot)) {
+        reference.reset();
+    }
+    else if (!reference || !hasSameReference(referenceState, snapshot)) {
+        reference = std::make_unique<ReferenceOrbit>(computeReferenceOrbit(snapshot));
+        referenceState = snapshot;
+    }
+    if (kernels) *kernels = selectKernels(snapshot, reference.get(), backHeight);
+    else kernels = std::make_unique<FractalKernels>(selectKernels(snapshot, reference.get(), backHeight));
+    coloring = Coloring(snapshot);
+    counters.assign(pool.getThreadCount(), KernelCounters());
+
+    makeTiles(backWidth, backHeight, RENDER_TILE_SIZE, tiles);
+
+    busy = true;
+    pool.submit(tiles, [this](const RenderTile& tile, int threadIndex) {
+        renderFractalRegion(backPixels.data(), 0, snapshot, coloring, *kernels, tile, backWidth, backHeight,
+            scratch[threadIndex], counters[threadIndex]);
+    });
+}
+
+bool SeedAnimator::finish() {
+    if (!busy || !pool.isIdle()) return false;
+    busy = false;
+
+    frameTime = pool.getLongestBusyTime();
+    frameCounters = KernelCounters();
+    for (const KernelCounters& workerCounters : counters) frameCounters.add(workerCounters);
+    budget.addJob(frameCounters, static_cast<long long>(backWidth) * backHeight, frameTime);
+
+    std::swap(frontPixels, backPixels);
+    std::swap(frontWidth, backWidth);
+    std::swap(frontHeight, backHeight);
+    return true;
+}
+
+void SeedAnimator::cancel() {
+    if (!busy) return;
+    pool.cancel();
+    pool.wait();
+    busy = false;
+}
+
+void SeedAnimator::present(sf::Texture& texture, sf::Sprite& sprite, int windowWidth, int windowHeight) const {
+    if (frontPixels.empty() || static_cast<unsigned>(frontWidth) > texture.getSize().x ||
+        static_cast<unsigned>(frontHeight) > texture.getSize().y) {
+        return;
+    }
+    texture.update(frontPixels.data(), frontWidth, frontHeight, 0, 0);
+    sprite.setTextureRect(sf::IntRect(0, 0, frontWidth, frontHeight));
+    sprite.setScale(static_cast<float>(windowWidth) / frontWidth, static_cast<float>(windowHeight) / frontHeight);
+}
+
+// Iterates the pixels columns[0..count) of the row at `ci`, whose results
+// and orbits live at rowStart + x in the planes, and stores what they end
+// with; `rowInfo[k]` gets the result of columns[k]. Pixels with a saved orbit
+// below the limit carry on from it, the others start over. Without `orbits`
+// every pixel starts over. `count` is at most RENDER_TILE_SIZE.
+void iteratePixels(const RenderState& state, const FractalKernels& kernels, double originX, double pixelWidth,
+    double ci, const int* columns, int count, ResultPlanes& results, OrbitPlanes* orbits, int rowStart,
+    ReturnInfo* rowInfo, KernelCounters& counters) {
+    if (!orbits) {
+        kernels.row(state, originX, pixelWidth, ci, columns, count, rowInfo, nullptr, counters);
+        for (int k = 0; k < count; k++) results.set(rowStart + columns[k], rowInfo[k]);
+        return;
+    }
+
+    int resumed[RENDER_TILE_SIZE];
+    int resumedCount = 0;
+    for (int k = 0; k < count; k++) {
+        int index = rowStart + columns[k];
+        if (orbits->ends[index] == OrbitEnd::Saved && orbits->iterations[index] < state.maxIterations) {
+            resumed[resumedCount++] = k;
+        }
+    }
+
+    OrbitState rowOrbits[RENDER_TILE_SIZE];
+    if (resumedCount == 0) {
+        kernels.row(state, originX, pixelWidth, ci, columns, count, rowInfo, rowOrbits, counters);
+    }
+    else {
+        // Each group goes through its kernel packed, then back to its columns.
+        int xs[RENDER_TILE_SIZE];
+        ReturnInfo info[RENDER_TILE_SIZE];
+        OrbitState orbit[RENDER_TILE_SIZE];
+        int fresh[RENDER_TILE_SIZE];
+        int freshCount = 0;
+        for (int k = 0, next = 0; k < count; k++) {
+            if (next < resumedCount && resumed[next] == k) next++;
+            else fresh[freshCount++] = k;
+        }
+
+        for (int j = 0; j < freshCount; j++) xs[j] = columns[fresh[j]];
+        kernels.row(state, originX, pixelWidth, ci, xs, freshCount, info, orbit, counters);
+        for (int j = 0; j < freshCount; j++) {
+            rowInfo[fresh[j]] = info[j];
+            rowOrbits[fresh[j]] = orbit[j];
+        }
+
+        for (int j = 0; j < resumedCount; j++) {
+            xs[j] = columns[resumed[j]];
+            info[j] = results.get(rowStart + xs[j]);
+            orbit[j] = orbits->get(rowStart + xs[j]);
+        }
+        kernels.resume(state, originX, pixelWidth, ci, xs, resumedCount, info, orbit, counters);
+        for (int j = 0; j < resumedCount; j++) {
+            rowInfo[resumed[j]] = info[j];
+            rowOrbits[resumed[j]] = orbit[j];
+        }
+    }
+
+    for (int k = 0; k < count; k++) {
+        results.set(rowStart + columns[k], rowInfo[k]);
+        orbits->set(rowStart + columns[k], rowOrbits[k]);
+    }
+}
+
+// Mariani–Silver fill: iterates the border of a rectangle and, when all of
+// it has the same result, fills the inside instead of iterating it; otherwise
+// splits the rectangle in half and repeats on both halves. Results go to
+// `results`, `orbits` (when not null) and `computed`, where pixel (x, y) of
+// the image lives at first + (y - startY) * stride + (x - startX); computed
+// pixels are never iterated.
+class RectangleSubdivision {
+public:
+    RectangleSubdivision(const RenderState& state, const FractalKernels& kernels, int width, int height,
+        ResultPlanes& results, OrbitPlanes* orbits, sf::Uint8* computed, int first, int stride, int startX,
+        int startY, KernelCounters& counters);
+
+    void run(const RenderTile& tile);
+
+private:
+    // Rectangles narrower than this are left to the row pass at the end,
+    // which iterates them with full-width rows.
+    static constexpr int MIN_SIZE = 8;
+
+    int index(int x, int y) const { return first + (y - startY) * stride + (x - startX); }
+    // Coordinates are inclusive.
+    void iterateRow(int y, int x0, int x1);
+    void iterateColumn(int x, int y0, int y1);
+    // Whether every pixel from (x0, y0) to (x1, y1) escaped after `iteration` iterations.
+    bool allMatch(int x0, int y0, int x1, int y1, int iteration) const;
+    // Whether no pixel on the border of the rectangle reached the limit.
+    bool hasFinalBorder(int x0, int y0, int x1, int y1) const;
+    void fill(int x0, int y0, int x1, int y1);
+    void subdivide(int x0, int y0, int x1, int y1);
+
+    const RenderState& state;
+    const FractalKernels& kernels;
+    double originX;
+    double originY;
+    double pixelWidth;
+    double pixelHeight;
+    ResultPlanes& results;
+    OrbitPlanes* orbits;
+    sf::Uint8* computed;
+    int first;
+    int stride;
+    int startX;
+    int startY;
+    KernelCounters& counters;
+};
+
+bool usesSolidFill(const RenderState& state) {
+    // With the inner calculation on no point stays at -1.
+    return state.solidFill == SolidFill::Bands ||
+        (state.solidFill == SolidFill::Interior && !state.innerCalculation);
+}
+
+RectangleSubdivision::RectangleSubdivision(const RenderState& state, const FractalKernels& kernels, int width, int height,
+    ResultPlanes& results, OrbitPlanes* orbits, sf::Uint8* computed, int first, int stride, int startX, int startY,
+    KernelCounters& counters)
+    : state(state), kernels(kernels),
+    originX(kernels.centerX - state.getViewportWidth() / 2),
+    originY(kernels.centerY - state.viewportHeight / 2),
+    pixelWidth(state.getViewportWidth() / width),
+    pixelHeight(state.viewportHeight / height),
+    results(results), orbits(orbits), computed(computed), first(first), stride(stride), startX(startX),
+    startY(startY), counters(counters) {
+}
+
+void RectangleSubdivision::run(const RenderTile& tile) {
+    subdivide(tile.startX, tile.startY, tile.endX - 1, tile.endY - 1);
+
+    for (int y = tile.startY; y < tile.endY; y++) {
+        iterateRow(y, tile.startX, tile.endX - 1);
+    }
+}
+
+void RectangleSubdivision::iterateRow(int y, int x0, int x1) {
+    int columns[RENDER_TILE_SIZE];
+    ReturnInfo rowInfo[RENDER_TILE_SIZE];
+    double ci = originY + y * pixelHeight;
+
+    int x = x0;
+    while (x <= x1) {
+        int count = 0;
+        for (; x <= x1 && count < RENDER_TILE_SIZE; x++) {
+            if (!computed[index(x, y)]) columns[count++] = x;
+        }
+        if (count == 0) continue;
+
+        iteratePixels(state, kernels, originX, pixelWidth, ci, columns, count, results, orbits, index(0, y),
+            rowInfo, counters);
+        for (int k = 0; k < count; k++) {
+            computed[index(columns[k], y)] = 1;
+        }
+    }
+}
+
+void RectangleSubdivision::iterateColumn(int x, int y0, int y1) {
+    ReturnInfo info;
+    for (int y = y0; y <= y1; y++) {
+        int i = index(x, y);
+        if (computed[i]) continue;
+
+        // A row of one pixel runs the scalar kernel, like the pixel kernel would.
+        iteratePixels(state, kernels, originX, pixelWidth, originY + y * pixelHeight, &x, 1, results, orbits,
+            index(0, y), &info, counters);
+        computed[i] = 1;
+    }
+}
+
+bool RectangleSubdivision::allMatch(int x0, int y0, int x1, int y1, int iteration) const {
+    for (int y = y0; y <= y1; y++) {
+        for (int x = x0; x <= x1; x++) {
+            if (results.iterations[index(x, y)] != iteration) return false;
+        }
+    }
+    return true;
+}
+
+bool RectangleSubdivision::hasFinalBorder(int x0, int y0, int x1, int y1) const {
+    for (int x = x0; x <= x1; x++) {
+        if (orbits->ends[index(x, y0)] != OrbitEnd::Final || orbits->ends[index(x, y1)] != OrbitEnd::Final) return false;
+    }
+    for (int y = y0; y <= y1; y++) {
+        if (orbits->ends[index(x0, y)] != OrbitEnd::Final || orbits->ends[index(x1, y)] != OrbitEnd::Final) return false;
+    }
+    return true;
+}
+
+void RectangleSubdivision::fill(int x0, int y0, int x1, int y1) {
+    int iteration = results.iterations[index(x0, y0)];
+    // Filled pixels have no orbit of their own. Inside a border that reached
+    // the limit they start over under a higher one.
+    OrbitState filledOrbit = { OrbitEnd::Final, state.maxIterations, 0, 0 };
+    if (orbits && iteration == -1 && !hasFinalBorder(x0, y0, x1, y1)) filledOrbit.end = OrbitEnd::Limit;
+
+    for (int y = y0 + 1; y < y1; y++) {
+        double ty = static_cast<double>(y - y0) / (y1 - y0);
+        ReturnInfo left = results.get(index(x0, y));
+        ReturnInfo right = results.get(index(x1, y));
+
+        for (int x = x0 + 1; x < x1; x++) {
+            int i = index(x, y);
+            if (computed[i]) continue;
+            computed[i] = 1;
+            counters.filledPixels++;
+            if (orbits) orbits->set(i, filledOrbit);
+
+            if (iteration == -1) {
+                results.set(i, { -1, 0, 0 });
+                continue;
+            }
+
+            // Average of the horizontal and vertical interpolations across the border.
+            double tx = static_cast<double>(x - x0) / (x1 - x0);
+            ReturnInfo top = results.get(index(x, y0));
+            ReturnInfo bottom = results.get(index(x, y1));
+            results.set(i, { iteration,
+                0.5 * ((1 - tx) * left.smoothIteration + tx * right.smoothIteration +
+                    (1 - ty) * top.smoothIteration + ty * bottom.smoothIteration),
+                0.5 * ((1 - tx) * left.stripeAverage + tx * right.stripeAverage +
+                    (1 - ty) * top.stripeAverage + ty * bottom.stripeAverage) });
+        }
+    }
+}
+
+void RectangleSubdivision::subdivide(int x0, int y0, int x1, int y1) {
+    int rectWidth = x1 - x0;
+    int rectHeight = y1 - y0;
+
+    if (rectWidth < MIN_SIZE || rectHeight < MIN_SIZE) return;
+
+    // The sides go through the scalar kernel, so they are only iterated once
+    // the top and bottom rows agree.
+    iterateRow(y0, x0, x1);
+    iterateRow(y1, x0, x1);
+    int iteration = results.iterations[index(x0, y0)];
+    bool uniform = (iteration == -1 || state.solidFill == SolidFill::Bands) &&
+        allMatch(x0, y0, x1, y0, iteration) && allMatch(x0, y1, x1, y1, iteration);
+
+    if (uniform) {
+        iterateColumn(x0, y0 + 1, y1 - 1);
+        iterateColumn(x1, y0 + 1, y1 - 1);
+        if (allMatch(x0, y0, x0, y1, iteration) && allMatch(x1, y0, x1, y1, iteration)) {
+            fill(x0, y0, x1, y1);
+            return;
+        }
+    }
+
+    // The halves share the split line, which is then iterated only once.
+    if (rectWidth >= rectHeight) {
+        int mid = x0 + rectWidth / 2;
+        subdivide(x0, y0, mid, y1);
+        subdivide(mid, y0, x1, y1);
+    }
+    else {
+        int mid = y0 + rectHeight / 2;
+        subdivide(x0, y0, x1, mid);
+        subdivide(x0, mid, x1, y1);
+    }
+}
+
+void renderFractalRegion(sf::Uint8* pixels, int firstRow, const RenderState& state, const Coloring& coloring,
+    const FractalKernels& kernels, const RenderTile& tile, int width, int height, AntiAliasingScratch& scratch,
+    KernelCounters& counters) {
+    double pixelHeight = state.viewportHeight / height;
+    double pixelWidth = state.getViewportWidth() / width;
+    double halfHeight = state.viewportHeight / 2;
+    double halfWidth = state.getViewportWidth() / 2;
+
+    // Edge detection compares every pixel with its neighbours, so with
+    // anti-aliasing on the ring around the tile is iterated as well.
+    RenderTile area = expandTile(tile, state.antiAliasing ? 1 : 0, width, height);
+    int stride = area.endX - area.startX;
+    ResultPlanes& results = scratch.centers;
+
+    if (usesSolidFill(state)) {
+        std::fill(scratch.computed.begin(), scratch.computed.end(), 0);
+        RectangleSubdivision(state, kernels, width, height, results, nullptr, scratch.computed.data(),
+            0, stride, area.startX, area.startY, counters).run(area);
+    }
+    else {
+        int columns[RENDER_TILE_SIZE + 2];
+        ReturnInfo rowInfo[RENDER_TILE_SIZE + 2];
+        for (int x = area.startX; x < area.endX; x++) columns[x - area.startX] = x;
+
+        for (int y = area.startY; y < area.endY; y++) {
+            double ci = kernels.centerY - halfHeight + y * pixelHeight;
+            kernels.row(state, kernels.centerX - halfWidth, pixelWidth, ci, columns, stride, rowInfo, nullptr,
+                counters);
+            for (int k = 0; k < stride; k++) results.set((y - area.startY) * stride + k, rowInfo[k]);
+        }
+    }
+
+    // Colors go to the band a whole tile row at a time.
+    int tileWidth = tile.endX - tile.startX;
+    sf::Uint8* tilePixels = pixels + ((tile.startY - firstRow) * width + tile.startX) * 4;
+    for (int y = tile.startY; y < tile.endY; y++) {
+        int first = (y - area.startY) * stride + (tile.startX - area.startX);
+        coloring.colorize(results, first, tileWidth, tilePixels + (y - tile.startY) * width * 4, nullptr);
+        for (int k = first; k < first + tileWidth; k++) {
+            int iteration = results.iterations[k];
+            counters.iterations += (iteration < 0) ? state.maxIterations : iteration;
+        }
+    }
+
+    if (state.antiAliasing) {
+        refineEdges(tilePixels, width, nullptr, state, coloring, kernels, tile, area, width, height, scratch,
+            counters);
+    }
+}
+
+void FrameBuffer::invalidate() {
+    std::fill(computed.begin(), computed.end(), 0);
+    // The orbits belong to the old view.
+    std::fill(orbits.ends.begin(), orbits.ends.end(), OrbitEnd::Limit);
+    clearRefined();
+}
+
+void FrameBuffer::clearRefined() {
+    std::fill(refined.begin(), refined.end(), 0);
+}
+
+// Copies `source` to `destination` moved like FrameBuffer::shift, a run
+// inside one source and one destination tile at a time.
+template <typename T, typename Allocator>
+void shiftPlane(const FrameBuffer& layout, const std::vector<T, Allocator>& source,
+    std::vector<T, Allocator>& destination, int channels, int offsetX, int offsetY, T fill) {
+    int width = layout.width;
+    int height = layout.height;
+    destination.resize(source.size());
+
+    for (int y = 0; y < height; y++) {
+        int sourceY = y + offsetY;
+        int x = 0;
+        while (x < width) {
+            int sourceX = x + offsetX;
+            int runEnd = std::min(width, x / RENDER_TILE_SIZE * RENDER_TILE_SIZE + RENDER_TILE_SIZE);
+            T* target = destination.data() + layout.index(x, y) * channels;
+
+            if (sourceY < 0 || sourceY >= height || sourceX >= width) {
+                std::fill(target, target + (runEnd - x) * channels, fill);
+            }
+            else if (sourceX < 0) {
+                runEnd = std::min(runEnd, x - sourceX);
+                std::fill(target, target + (runEnd - x) * channels, fill);
+            }
+            else {
+                int sourceEnd = std::min(width, sourceX / RENDER_TILE_SIZE * RENDER_TILE_SIZE + RENDER_TILE_SIZE);
+                runEnd = std::min(runEnd, x + sourceEnd - sourceX);
+                const T* from = source.data() + layout.index(sourceX, sourceY) * channels;
+                std::copy(from, from + (runEnd - x) * channels, target);
+            }
+            x = runEnd;
+        }
+    }
+}
+
+void FrameBuffer::shift(int offsetX, int offsetY) {
+    gridOriginX -= offsetX;
+    gridOriginY -= offsetY;
+
+    shiftPlane(*this, results.iterations, scratchResults.iterations, 1, offsetX, offsetY, -1);
+    shiftPlane(*this, results.smoothIterations, scratchResults.smoothIterations, 1, offsetX, offsetY, 0.0);
+    shiftPlane(*this, results.stripeAverages, scratchResults.stripeAverages, 1, offsetX, offsetY, 0.0);
+    results.swap(scratchResults);
+    shiftPlane(*this, orbits.ends, scratchOrbits.ends, 1, offsetX, offsetY, OrbitEnd::Limit);
+    shiftPlane(*this, orbits.iterations, scratchOrbits.iterations, 1, offsetX, offsetY, 0);
+    shiftPlane(*this, orbits.zr, scratchOrbits.zr, 1, offsetX, offsetY, 0.0);
+    shiftPlane(*this, orbits.zi, scratchOrbits.zi, 1, offsetX, offsetY, 0.0);
+    orbits.swap(scratchOrbits);
+    shiftPlane<sf::Uint8>(*this, pixels, scratchPixels, 4, offsetX, offsetY, 0);
+    pixels.swap(scratchPixels);
+    // Both byte planes go through the one scratch plane.
+    shiftPlane<sf::Uint8>(*this, computed, scratchComputed, 1, offsetX, offsetY, 0);
+    computed.swap(scratchComputed);
+    shiftPlane<sf::Uint8>(*this, refined, scratchComputed, 1, offsetX, offsetY, 0);
+    refined.swap(scratchComputed);
+
+    // The fill above also zeroed alpha.
+    for (size_t i = 3; i < pixels.size(); i += 4) {
+        pixels[i] = 255;
+    }
+}
+
+// Splits `value / divisor` into its floor and whether the division was exact.
+inline int floorDivide(int value, int divisor, bool& exact) {
+    int quotient = value / divisor;
+    int remainder = value % divisor;
+    if (remainder < 0) quotient--;
+    exact = (remainder == 0);
+    return quotient;
+}
+
+void FrameBuffer::rescale(int baseX, int baseY, int step, int divisor) {
+    scratchPixels.resize(pixels.size());
+    scratchResults.resize(results.size());
+    scratchOrbits.resize(results.size());
+    scratchComputed.resize(computed.size());
+
+    for (int y = 0; y < height; y++) {
+        bool exactY;
+        int oldY = floorDivide(baseY + y * step, divisor, exactY);
+
+        for (int x = 0; x < width; x++) {
+            bool exactX;
+            int oldX = floorDivide(baseX + x * step, divisor, exactX);
+            int index = this->index(x, y);
+
+            if (oldX < 0 || oldX >= width || oldY < 0 || oldY >= height) {
+                writePixel(scratchPixels.data(), index * 4, sf::Color(0, 0, 0));
+                scratchOrbits.ends[index] = OrbitEnd::Limit;
+                scratchComputed[index] = 0;
+                continue;
+            }
+
+            int oldIndex = this->index(oldX, oldY);
+            bool exact = exactX && exactY;
+            std::copy(pixels.begin() + oldIndex * 4, pixels.begin() + oldIndex * 4 + 4, scratchPixels.begin() + index * 4);
+            scratchResults.set(index, results.get(oldIndex));
+            // Only a pixel on an old sample has the same orbit.
+            scratchOrbits.set(index, orbits.get(oldIndex));
+            if (!exact) scratchOrbits.ends[index] = OrbitEnd::Limit;
+            scratchComputed[index] = exact ? computed[oldIndex] : 0;
+        }
+    }
+
+    pixels.swap(scratchPixels);
+    results.swap(scratchResults);
+    orbits.swap(scratchOrbits);
+    computed.swap(scratchComputed);
+    clearRefined();
+}
+
+void FrameBuffer::applyLimit(int limit) {
+    for (size_t i = 0; i < computed.size(); i++) {
+        int iteration = results.iterations[i];
+        if (orbits.ends[i] == OrbitEnd::Final) {
+            // Escaped pixels keep their result under any limit above their
+            // iteration count, interior ones under any limit at all.
+            if (iteration >= limit) computed[i] = 0;
+            continue;
+        }
+
+        // The orbit went `reached` iterations without escaping, which is
+        // still -1 under a lower limit, but only the inner calculation at
+        // that very limit gives the same smooth value.
+        int reached = orbits.iterations[i];
+        if (limit == reached || (iteration == -1 && limit < reached)) continue;
+        computed[i] = 0;
+        // A saved orbit can only be carried on to a higher limit.
+        if (limit < reached) orbits.ends[i] = OrbitEnd::Limit;
+    }
+}
+
+RenderTile FrameBuffer::findRows(const CacheLineVector<sf::Uint8>& plane, sf::Uint8 value,
+    const RenderTile& tile) const {
+    RenderTile rows = { tile.startX, tile.endY, tile.endX, tile.endY };
+    int tileWidth = tile.endX - tile.startX;
+    for (int y = tile.startY; y < tile.endY; y++) {
+        const sf::Uint8* row = plane.data() + index(tile.startX, y);
+        if (std::find(row, row + tileWidth, value) == row + tileWidth) continue;
+        rows.startY = std::min(rows.startY, y);
+        rows.endY = y + 1;
+    }
+    return rows;
+}
+
+bool FrameBuffer::isComplete() const {
+    return std::find(computed.begin(), computed.end(), 0) == computed.end();
+}
+
+// Rounds towards negative infinity, for lattice positions left of the origin.
+inline int64_t floorDivide(int64_t value, int64_t divisor) {
+    int64_t quotient = value / divisor;
+    return (value % divisor != 0 && value < 0) ? quotient - 1 : quotient;
+}
+
+constexpr char TILE_CACHE_MAGIC[8] = { 'F', 'R', 'T', 'I', 'L', 'E', 'S', '1' };
+// Slots and the file header take whole pages.
+constexpr size_t TILE_CACHE_PAGE_SIZE = 4096;
+
+size_t TileCache::TileKeyHash::operator()(const TileKey& key) const {
+    // FNV-1a over the key's bytes.
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&key);
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < sizeof(TileKey); i++) {
+        hash = (hash ^ bytes[i]) * 1099511628211ull;
+    }
+    return static_cast<size_t>(hash);
+}
+
+TileCache::~TileCache() {
+    close();
+}
+
+bool TileCache::open(const std::string& path, long long capacityBytes) {
+    close();
+    slotSize = sizeof(SlotHeader) + RENDER_TILE_SIZE * RENDER_TILE_SIZE * (1 + sizeof(ReturnInfo));
+    slotSize = (slotSize + TILE_CACHE_PAGE_SIZE - 1) / TILE_CACHE_PAGE_SIZE * TILE_CACHE_PAGE_SIZE;
+    slotCount = static_cast<size_t>(std::max(1LL, capacityBytes / static_cast<long long>(slotSize)));
+    mappingSize = TILE_CACHE_PAGE_SIZE + slotCount * slotSize;
+
+    // A file of another size is emptied and grown, which leaves it all zeros.
+#ifdef _WIN32
+    file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL,
+        nullptr);
+    if (file == INVALID_HANDLE_VALUE) return false;
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize)) {
+        close();
+        return false;
+    }
+    if (static_cast<unsigned long long>(fileSize.QuadPart) != mappingSize) {
+        LARGE_INTEGER position;
+        position.QuadPart = 0;
+        SetFilePointerEx(file, position, nullptr, FILE_BEGIN);
+        SetEndOfFile(file);
+    }
+    fileMapping = CreateFileMappingA(file, nullptr, PAGE_READWRITE, static_cast<DWORD>(mappingSize >> 32),
+        static_cast<DWORD>(mappingSize & 0xffffffff), nullptr);
+    if (!fileMapping) {
+        close();
+        return false;
+    }
+    mapping = static_cast<unsigned char*>(MapViewOfFile(fileMapping, FILE_MAP_ALL_ACCESS, 0, 0, mappingSize));
+    if (!mapping) {
+        close();
+        return false;
+    }
+#else
+    file = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (file < 0) return false;
+    struct stat fileStatus;
+    if (fstat(file, &fileStatus) != 0) {
+        close();
+        return false;
+    }
+    if (static_cast<unsigned long long>(fileStatus.st_size) != mappingSize &&
+        (ftruncate(file, 0) != 0 || ftruncate(file, static_cast<off_t>(mappingSize)) != 0)) {
+        close();
+        return false;
+    }
+    void* view = mmap(nullptr, mappingSize, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+    if (view == MAP_FAILED) {
+        close();
+        return false;
+    }
+    mapping = static_cast<unsigned char*>(view);
+#endif
+
+    FileHeader& header = *reinterpret_cast<FileHeader*>(mapping);
+    bool sameLayout = std::memcmp(header.magic, TILE_CACHE_MAGIC, sizeof(header.magic)) == 0 &&
+        header.tileSize == RENDER_TILE_SIZE && header.resultSize == sizeof(ReturnInfo) && header.slotCount == slotCount;
+    if (!sameLayout) {
+        for (size_t slot = 0; slot < slotCount; slot++) getSlot(slot).used = 0;
+        std::memcpy(header.magic, TILE_CACHE_MAGIC, sizeof(header.magic));
+        header.tileSize = RENDER_TILE_SIZE;
+        header.resultSize = sizeof(ReturnInfo);
+        header.slotCount = slotCount;
+    }
+
+    for (size_t slot = 0; slot < slotCount; slot++) {
+        const SlotHeader& entry = getSlot(slot);
+        if (!entry.used) {
+            freeSlots.push_back(slot);
+            continue;
+        }
+        slots[entry.key] = slot;
+        useCounter = std::max(useCounter, entry.lastUse);
+    }
+    return true;
+}
+
+void TileCache::close() {
+#ifdef _WIN32
+    if (mapping) UnmapViewOfFile(mapping);
+    if (fileMapping) CloseHandle(fileMapping);
+    if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+    fileMapping = nullptr;
+    file = INVALID_HANDLE_VALUE;
+#else
+    if (mapping) munmap(mapping, mappingSize);
+    if (file >= 0) ::close(file);
+    file = -1;
+#endif
+    mapping = nullptr;
+    slots.clear();
+    freeSlots.clear();
+    useCounter = 0;
+}
+
+TileCache::SlotHeader& TileCache::getSlot(size_t slot) {
+    return *reinterpret_cast<SlotHeader*>(mapping + TILE_CACHE_PAGE_SIZE + slot * slotSize);
+}
+
+sf::Uint8* TileCache::getSlotMask(size_t slot) {
+    return mapping + TILE_CACHE_PAGE_SIZE + slot * slotSize + sizeof(SlotHeader);
+}
+
+ReturnInfo* TileCache::getSlotData(size_t slot) {
+    return reinterpret_cast<ReturnInfo*>(getSlotMask(slot) + RENDER_TILE_SIZE * RENDER_TILE_SIZE);
+}
+
+size_t TileCache::takeSlot() {
+    if (!freeSlots.empty()) {
+        size_t slot = freeSlots.back();
+        freeSlots.pop_back();
+        return slot;
+    }
+
+    auto oldest = slots.begin();
+    for (auto entry = slots.begin(); entry != slots.end(); ++entry) {
+        if (getSlot(entry->second).lastUse < getSlot(oldest->second).lastUse) oldest = entry;
+    }
+    size_t slot = oldest->second;
+    slots.erase(oldest);
+    return slot;
+}
+
+bool TileCache::getGrid(const RenderState& state, int width, int height, FrameGrid& grid) {
+    Precision precision = selectPrecision(state, height);
+    if (precision == Precision::Perturbation) return false;
+
+    double pixelWidth = state.getViewportWidth() / width;
+    double pixelHeight = state.viewportHeight / height;
+    // Frame pixel (0, 0) in lattice pixels, with the phase in fixed point.
+    double latticeX = (state.viewportX - state.getViewportWidth() / 2) / pixelWidth;
+    double latticeY = (state.viewportY - state.viewportHeight / 2) / pixelHeight;
+    const double limit = std::ldexp(1.0, 46);
+    if (!(std::fabs(latticeX) < limit && std::fabs(latticeY) < limit)) return false;
+    long long fixedX = std::llround(latticeX * TILE_CACHE_PHASE_STEPS);
+    long long fixedY = std::llround(latticeY * TILE_CACHE_PHASE_STEPS);
+    grid.originX = floorDivide(fixedX, TILE_CACHE_PHASE_STEPS);
+    grid.originY = floorDivide(fixedY, TILE_CACHE_PHASE_STEPS);
+
+    // Settings the kernels ignore are zeroed so they don't split the cache.
+    TileKey& key = grid.key;
+    key = TileKey();
+    key.fractalType = state.fractalType;
+    key.flags = (state.showJulia ? 1 : 0) | (state.stripes ? 2 : 0) | (state.innerCalculation ? 4 : 0);
+    key.maxIterations = state.maxIterations;
+    key.solidFill = static_cast<int64_t>(state.solidFill);
+    key.precision = static_cast<int64_t>(precision);
+    key.stripeFrequency = state.stripes ? state.stripeFrequency : 0;
+    key.juliaX = state.showJulia ? state.juliaX : 0;
+    key.juliaY = state.showJulia ? state.juliaY : 0;
+    key.pixelWidth = pixelWidth;
+    key.pixelHeight = pixelHeight;
+    key.phaseX = fixedX - grid.originX * TILE_CACHE_PHASE_STEPS;
+    key.phaseY = fixedY - grid.originY * TILE_CACHE_PHASE_STEPS;
+    return true;
+}
+
+int TileCache::fill(FrameBuffer& frame, const RenderState& state, const Coloring& coloring, const RenderTile& tile) {
+    FrameGrid grid;
+    if (!mapping || !getGrid(state, frame.width, frame.height, grid)) return 0;
+
+    // Pixels of `tile` filled here, colored once the lock is released.
+    std::array<sf::Uint8, RENDER_TILE_SIZE * RENDER_TILE_SIZE> filled{};
+    int tileWidth = tile.endX - tile.startX;
+    int count = 0;
+    int64_t firstX = floorDivide(grid.originX + tile.startX, RENDER_TILE_SIZE);
+    int64_t lastX = floorDivide(grid.originX + tile.endX - 1, RENDER_TILE_SIZE);
+    int64_t firstY = floorDivide(grid.originY + tile.startY, RENDER_TILE_SIZE);
+    int64_t lastY = floorDivide(grid.originY + tile.endY - 1, RENDER_TILE_SIZE);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (int64_t tileY = firstY; tileY <= lastY; tileY++) {
+            for (int64_t tileX = firstX; tileX <= lastX; tileX++) {
+                TileKey key = grid.key;
+                key.tileX = tileX;
+                key.tileY = tileY;
+                auto entry = slots.find(key);
+                if (entry == slots.end()) continue;
+
+                getSlot(entry->second).lastUse = ++useCounter;
+                const sf::Uint8* mask = getSlotMask(entry->second);
+                const ReturnInfo* results = getSlotData(entry->second);
+                // The cached tile in frame pixels, clipped to `tile`.
+                int left = static_cast<int>(tileX * RENDER_TILE_SIZE - grid.originX);
+                int top = static_cast<int>(tileY * RENDER_TILE_SIZE - grid.originY);
+                int startX = std::max(tile.startX, left);
+                int endX = std::min(tile.endX, left + RENDER_TILE_SIZE);
+                int startY = std::max(tile.startY, top);
+                int endY = std::min(tile.endY, top + RENDER_TILE_SIZE);
+
+                for (int y = startY; y < endY; y++) {
+                    for (int x = startX; x < endX; x++) {
+                        int index = frame.index(x, y);
+                        int cachedIndex = (y - top) * RENDER_TILE_SIZE + (x - left);
+                        if (frame.computed[index] || !mask[cachedIndex]) continue;
+                        const ReturnInfo& cached = results[cachedIndex];
+                        frame.results.set(index, cached);
+                        // The cache keeps no orbits, and -1 may be interior or the limit.
+                        bool reachedLimit = cached.iteration == -1 || cached.iteration >= state.maxIterations;
+                        frame.orbits.set(index,
+                            { reachedLimit ? OrbitEnd::Limit : OrbitEnd::Final, state.maxIterations, 0, 0 });
+                        frame.computed[index] = 1;
+                        frame.refined[index] = 0;
+                        filled[(y - tile.startY) * tileWidth + (x - tile.startX)] = 1;
+                        count++;
+                    }
+                }
+            }
+        }
+    }
+
+    if (count == 0) return 0;
+    for (int y = tile.startY; y < tile.endY; y++) {
+        for (int x = tile.startX; x < tile.endX; x++) {
+            if (!filled[(y - tile.startY) * tileWidth + (x - tile.startX)]) continue;
+            int index = frame.index(x, y);
+            writePixel(frame.pixels.data(), index * 4, coloring.getColor(frame.results.get(index)));
+        }
+    }
+    return count;
+}
+
+int TileCache::store(const FrameBuffer& frame, const RenderState& state) {
+    FrameGrid grid;
+    if (!mapping || !getGrid(state, frame.width, frame.height, grid)) return 0;
+
+    int64_t firstX = floorDivide(grid.originX, RENDER_TILE_SIZE);
+    int64_t lastX = floorDivide(grid.originX + frame.width - 1, RENDER_TILE_SIZE);
+    int64_t firstY = floorDivide(grid.originY, RENDER_TILE_SIZE);
+    int64_t lastY = floorDivide(grid.originY + frame.height - 1, RENDER_TILE_SIZE);
+    int stored = 0;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    for (int64_t tileY = firstY; tileY <= lastY; tileY++) {
+        for (int64_t tileX = firstX; tileX <= lastX; tileX++) {
+            TileKey key = grid.key;
+            key.tileX = tileX;
+            key.tileY = tileY;
+            auto entry = slots.find(key);
+            bool full = entry != slots.end() &&
+                getSlot(entry->second).cachedPixels == RENDER_TILE_SIZE * RENDER_TILE_SIZE;
+            if (full) continue;
+
+            // The tile in frame pixels, clipped to the frame.
+            int left = static_cast<int>(tileX * RENDER_TILE_SIZE - grid.originX);
+            int top = static_cast<int>(tileY * RENDER_TILE_SIZE - grid.originY);
+            int startX = std::max(0, left);
+            int endX = std::min(frame.width, left + RENDER_TILE_SIZE);
+            int startY = std::max(0, top);
+            int endY = std::min(frame.height, top + RENDER_TILE_SIZE);
+
+            size_t slot;
+            if (entry != slots.end()) {
+                slot = entry->second;
+            }
+            else {
+                slot = takeSlot();
+                SlotHeader& taken = getSlot(slot);
+                taken.used = 0;
+                std::fill(getSlotMask(slot), getSlotMask(slot) + RENDER_TILE_SIZE * RENDER_TILE_SIZE, 0);
+                taken.key = key;
+                taken.cachedPixels = 0;
+                taken.used = 1;
+                slots[key] = slot;
+            }
+
+            SlotHeader& header = getSlot(slot);
+            sf::Uint8* mask = getSlotMask(slot);
+            ReturnInfo* results = getSlotData(slot);
+            header.lastUse = ++useCounter;
+            for (int y = startY; y < endY; y++) {
+                for (int x = startX; x < endX; x++) {
+                    int index = frame.index(x, y);
+                    int cachedIndex = (y - top) * RENDER_TILE_SIZE + (x - left);
+                    if (!frame.computed[index] || mask[cachedIndex]) continue;
+                    results[cachedIndex] = frame.results.get(index);
+                    mask[cachedIndex] = 1;
+                    header.cachedPixels++;
+                    stored++;
+                }
+            }
+        }
+    }
+    return stored;
+}
+
+void renderPendingRegion(FrameBuffer& frame, const RenderState& state, const Coloring& coloring,
+    const FractalKernels& kernels, const RenderTile& tile, bool recolorAll, KernelCounters& counters) {
+    int width = frame.width;
+    int height = frame.height;
+    double pixelHeight = state.viewportHeight / height;
+    double pixelWidth = state.getViewportWidth() / width;
+    double halfHeight = state.viewportHeight / 2;
+    double halfWidth = state.getViewportWidth() / 2;
+
+    if (usesSolidFill(state)) {
+        RectangleSubdivision(state, kernels, width, height, frame.results, &frame.orbits, frame.computed.data(),
+            frame.index(tile.startX, tile.startY), frame.getTileWidth(tile.startX), tile.startX, tile.startY,
+            counters).run(tile);
+        // Pixels computed earlier get the color they already have unless the coloring changed.
+        colorizeRegion(frame, coloring, tile);
+        return;
+    }
+
+    int columns[RENDER_TILE_SIZE];
+    ReturnInfo rowInfo[RENDER_TILE_SIZE];
+
+    for (int y = tile.startY; y < tile.endY; y++) {
+        double ci = kernels.centerY - halfHeight + y * pixelHeight;
+        // Pixel x of the row is at rowStart + x in the planes.
+        int rowStart = frame.index(tile.startX, y) - tile.startX;
+        sf::Uint8* computed = frame.computed.data() + rowStart;
+
+        int x = tile.startX;
+        while (x < tile.endX) {
+            int count = 0;
+            for (; x < tile.endX && count < RENDER_TILE_SIZE; x++) {
+                if (!computed[x]) columns[count++] = x;
+            }
+            if (count == 0) continue;
+
+            iteratePixels(state, kernels, kernels.centerX - halfWidth, pixelWidth, ci, columns, count, frame.results,
+                &frame.orbits, rowStart, rowInfo, counters);
+            for (int k = 0; k < count; k++) {
+                computed[columns[k]] = 1;
+                if (!recolorAll) {
+                    writePixel(frame.pixels.data(), (rowStart + columns[k]) * 4, coloring.getColor(rowInfo[k]));
+                }
+            }
+        }
+    }
+
+    if (recolorAll) {
+        colorizeRegion(frame, coloring, tile);
+    }
+}
+
+
+void renderCoarsePass(FrameBuffer& frame, const RenderState& state, const Coloring& coloring,
+    const FractalKernels& kernels, const RenderTile& tile, int downscale, bool recolorAll, KernelCounters& counters) {
+    int width = frame.width;
+    int height = frame.height;
+    double pixelHeight = state.viewportHeight / height;
+    double pixelWidth = state.getViewportWidth() / width;
+    double halfHeight = state.viewportHeight / 2;
+    double halfWidth = state.getViewportWidth() / 2;
+
+    // Sample positions stay on the global downscale grid so neighbouring tiles
+    // line up; pixels before a tile's first sample copy it.
+    int firstY = tile.startY + ((frame.gridOriginY - tile.startY) % downscale + downscale) % downscale;
+    int firstX = tile.startX + ((frame.gridOriginX - tile.startX) % downscale + downscale) % downscale;
+
+    int columns[RENDER_TILE_SIZE];
+    ReturnInfo rowInfo[RENDER_TILE_SIZE];
+
+    for (int y = firstY; y < tile.endY; y += downscale) {
+        double ci = kernels.centerY - halfHeight + y * pixelHeight;
+        int rowStart = frame.index(tile.startX, y) - tile.startX;
+        sf::Uint8* computed = frame.computed.data() + rowStart;
+
+        int x = firstX;
+        while (x < tile.endX) {
+            int count = 0;
+            for (; x < tile.endX && count < RENDER_TILE_SIZE; x += downscale) {
+                if (!computed[x]) columns[count++] = x;
+            }
+            if (count == 0) continue;
+
+            iteratePixels(state, kernels, kernels.centerX - halfWidth, pixelWidth, ci, columns, count, frame.results,
+                &frame.orbits, rowStart, rowInfo, counters);
+            for (int k = 0; k < count; k++) {
+                computed[columns[k]] = 1;
+            }
+        }
+
+        int blockStartY = (y == firstY) ? tile.startY : y;
+        int blockEndY = std::min(y + downscale, tile.endY);
+        sf::Uint8* pixels = frame.pixels.data();
+        const sf::Uint8* computedPlane = frame.computed.data();
+        const sf::Uint8* refined = frame.refined.data();
+
+        for (int sx = firstX; sx < tile.endX; sx += downscale) {
+            sf::Color color = coloring.getColor(frame.results.get(rowStart + sx));
+            int blockStartX = (sx == firstX) ? tile.startX : sx;
+            int blockEndX = std::min(sx + downscale, tile.endX);
+
+            // Computed pixels already show their own color unless the
+            // coloring changed; the sample itself may be new.
+            if (!refined[rowStart + sx]) writePixel(pixels, (rowStart + sx) * 4, color);
+            for (int by = blockStartY; by < blockEndY; by++) {
+                int blockStart = frame.index(blockStartX, by);
+                for (int index = blockStart; index < blockStart + blockEndX - blockStartX; index++) {
+                    if (!computedPlane[index]) {
+                        writePixel(pixels, index * 4, color);
+                    }
+                    else if (recolorAll && !refined[index]) {
+                        writePixel(pixels, index * 4, coloring.getColor(frame.results.get(index)));
+                    }
+                }
+            }
+        }
+    }
+}
+
+void colorizeRegion(FrameBuffer& frame, const Coloring& coloring, const RenderTile& tile) {
+    for (int y = tile.startY; y < tile.endY; y++) {
+        int first = frame.index(tile.startX, y);
+        coloring.colorize(frame.results, first, tile.endX - tile.startX, frame.pixels.data() + first * 4,
+            frame.refined.data() + first);
+    }
+}
+
+void Coloring::colorize(const ResultPlanes& results, int first, int count, sf::Uint8* rgba,
+    const sf::Uint8* skip) const {
+    const double* values = (stripes ? results.stripeAverages : results.smoothIterations).data() + first;
+    const int* iterations = results.iterations.data() + first;
+    const sf::Color* colors = lut->colors.data();
+    const sf::Color black(0, 0, 0);
+
+    // Table entries for a chunk first, in a loop that vectorizes, then one
+    // 4-byte load and store per pixel.
+    int indices[RENDER_TILE_SIZE];
+    for (int start = 0; start < count; start += RENDER_TILE_SIZE) {
+        int chunk = std::min(RENDER_TILE_SIZE, count - start);
+        if (equalization) {
+            for (int i = 0; i < chunk; i++) indices[i] = getIndex(getEqualizedPosition(values[start + i]));
+        }
+        else {
+            for (int i = 0; i < chunk; i++) indices[i] = getIndex(values[start + i] * scale);
+        }
+        for (int i = 0; i < chunk; i++) {
+            int k = start + i;
+            if (skip && skip[k]) continue;
+            std::memcpy(rgba + k * 4, iterations[k] == -1 ? &black : &colors[indices[i]], 4);
+        }
+    }
+}
+
+void IterationHistogram::reset(int threadCount, int maxIterations) {
+    bins = maxIterations;
+    counts.resize(threadCount);
+    for (std::vector<long long>& workerCounts : counts) workerCounts.assign(bins, 0);
+}
+
+std::shared_ptr<const std::vector<float>> IterationHistogram::getEqualization() {
+    total.assign(bins, 0);
+    for (const std::vector<long long>& workerCounts : counts) {
+        for (int bin = 0; bin < bins; bin++) total[bin] += workerCounts[bin];
+    }
+
+    if (!shares || shares.use_count() > 1) shares = std::make_shared<std::vector<float>>();
+    shares->assign(bins + 1, 0.0f);
+    long long sum = 0;
+    for (int bin = 0; bin < bins; bin++) sum += total[bin];
+    long long below = 0;
+    for (int bin = 0; bin < bins; bin++) {
+        (*shares)[bin] = sum > 0 ? static_cast<float>(static_cast<double>(below) / sum) : 0.0f;
+        below += total[bin];
+    }
+    (*shares)[bins] = 1.0f;
+    return shares;
+}
+
+
+// GLSL 1.10 port of calculateFractal and getColor for GpuRenderer. Float
+// throughout, so it only draws views hasFloatPixels accepts; the periodicity
+// check is left out since interior pixels are black either way. Texture
+// coordinates carry the pixel position, offset to the pixel center.
+const char GPU_FRACTAL_SHADER[] = R"(
+uniform vec2 origin;
+uniform vec2 pixelSize;
+uniform vec2 juliaSeed;
+uniform bool julia;
+uniform bool burningShip;
+uniform bool stripes;
+uniform bool innerCalculation;
+uniform int maxIterations;
+uniform float escapeRadiusSquared;
+uniform float stripeFrequency;
+uniform float stripeIntensity;
+uniform float colorDensity;
+uniform vec3 palette[16];
+uniform int paletteSize;
+
+void main() {
+    vec2 c = origin + (gl_TexCoord[0].xy - 0.5) * pixelSize;
+    vec2 z = julia ? c : vec2(0.0);
+    if (julia) c = juliaSeed;
+
+    if (!innerCalculation && !julia && !burningShip) {
+        float xq = c.x - 0.25;
+        float q = xq * xq + c.y * c.y;
+        if (q * (q + xq) < 0.25 * c.y * c.y || (c.x + 1.0) * (c.x + 1.0) + c.y * c.y < 0.0625) {
+            gl_FragColor = vec4(0.0, 0.0, 0.0, 1.0);
+            return;
+        }
+    }
+
+    float zr2 = z.x * z.x;
+    float zi2 = z.y * z.y;
+    float stripeSum = 0.0;
+    float stripe = 0.0;
+    int i = 0;
+    for (; i < maxIterations && zr2 + zi2 < escapeRadiusSquared; i++) {
+        float crossTerm = burningShip ? abs(z.x * z.y) : z.x * z.y;
+        z = vec2(zr2 - zi2 + c.x, 2.0 * crossTerm + c.y);
+        zr2 = z.x * z.x;
+        zi2 = z.y * z.y;
+        if (stripes) {
+            stripe = sin(atan(z.y, z.x) * stripeFrequency);
+            stripe *= stripe;
+            stripeSum += stripe;
+        }
+    }
+
+    if (i == maxIterations && !innerCalculation) {
+        gl_FragColor = vec4(0.0, 0.0, 0.0, 1.0);
+        return;
+    }
+
+    float iterations;
+    if (stripes) {
+        // Blended as in getStripeAverage.
+        float average = i > 0 ? stripeSum / float(i) : 0.0;
+        float previous = i > 1 ? (stripeSum - stripe) / float(i - 1) : average;
+        float weight = 0.0;
+        if (zr2 + zi2 >= escapeRadiusSquared) weight = clamp(log2(log(zr2 + zi2) / log(escapeRadiusSquared)), 0.0, 1.0);
+        iterations = stripeIntensity * mix(average, previous, weight);
+    }
+    else {
+        iterations = (float(i) + 1.0 - log(log(zr2 + zi2) / 2.0) / log(2.0)) * colorDensity;
+    }
+    int index = int(mod(floor(iterations), float(paletteSize)));
+    int next = index + 1 == paletteSize ? 0 : index + 1;
+    vec3 color = floor(palette[index] + fract(iterations) * (palette[next] - palette[index]));
+    gl_FragColor = vec4(color / 255.0, 1.0);
+}
+)";
+
+// Size of the palette array in GPU_FRACTAL_SHADER.
+constexpr int GPU_MAX_PALETTE_SIZE = 16;
+
+// Draws whole frames with GPU_FRACTAL_SHADER into a render texture, iterating
+// and coloring on the GPU without touching the pixel buffer. It covers the
+// shallow views it supports(); everything else stays on AsyncRenderer, and
+// the event loop shows whichever texture rendered the current view.
+class GpuRenderer : public RenderBackend {
+public:
+    // Needs a current GL context, such as the window's. Returns false when
+    // the driver has no shader support or the shader doesn't compile.
+    bool create(int width, int height);
+    // Float coordinates resolve the pixels and neither the anti-aliasing pass
+    // nor histogram coloring, which only the CPU path has, is needed.
+    bool supports(const RenderState& state) const override;
+    // Draws the whole frame before returning, whatever the mode.
+    void start(const RenderState& state, RenderMode mode) override;
+    void cancel() override {}
+    bool present() override;
+    const sf::Texture& getTexture() const override { return target.getTexture(); }
+
+private:
+    int width = 0;
+    int height = 0;
+    bool available = false;
+    bool drawn = false;
+    sf::Shader shader;
+    sf::RenderTexture target;
+    sf::VertexArray quad;
+    // The palette uniform, refilled for every frame in the same storage.
+    std::vector<sf::Glsl::Vec3> colors;
+};
+
+bool GpuRenderer::create(int targetWidth, int targetHeight) {
+    width = targetWidth;
+    height = targetHeight;
+    available = sf::Shader::isAvailable() && shader.loadFromMemory(GPU_FRACTAL_SHADER, sf::Shader::Fragment) &&
+        target.create(width, height);
+
+    // Texture coordinates in pixels; no texture is bound, so they reach the
+    // shader unscaled.
+    quad = sf::VertexArray(sf::TriangleStrip, 4);
+    quad[0] = sf::Vertex(sf::Vector2f(0, 0), sf::Vector2f(0, 0));
+    quad[1] = sf::Vertex(sf::Vector2f(width, 0), sf::Vector2f(width, 0));
+    quad[2] = sf::Vertex(sf::Vector2f(0, height), sf::Vector2f(0, height));
+    quad[3] = sf::Vertex(sf::Vector2f(width, height), sf::Vector2f(width, height));
+    colors.reserve(GPU_MAX_PALETTE_SIZE);
+    return available;
+}
+
+bool GpuRenderer::supports(const RenderState& state) const {
+    const auto& palette = PALETTES[state.colorScheme % PALETTES.size()];
+    return available && hasFloatPixels(state, height) && !state.antiAliasing && !usesHistogramColoring(state) &&
+        static_cast<int>(palette.size()) <= GPU_MAX_PALETTE_SIZE;
+}
+
+void GpuRenderer::start(const RenderState& state, RenderMode) {
+    const auto& palette = PALETTES[state.colorScheme % PALETTES.size()];
+    colors.clear();
+    for (const sf::Color& color : palette) colors.emplace_back(color.r, color.g, color.b);
+
+    double pixelHeight = state.viewportHeight / height;
+    double pixelWidth = state.getViewportWidth() / width;
+    shader.setUniform("origin", sf::Glsl::Vec2(static_cast<float>(state.viewportX - state.getViewportWidth() / 2),
+        static_cast<float>(state.viewportY - state.viewportHeight / 2)));
+    shader.setUniform("pixelSize", sf::Glsl::Vec2(static_cast<float>(pixelWidth), static_cast<float>(pixelHeight)));
+    shader.setUniform("juliaSeed", sf::Glsl::Vec2(static_cast<float>(state.juliaX), static_cast<float>(state.juliaY)));
+    shader.setUniform("julia", state.showJulia);
+    shader.setUniform("burningShip", state.fractalType == FRACTAL_BURNING_SHIP);
+    shader.setUniform("stripes", state.stripes);
+    // Names too long for the short-string buffer would allocate on every call.
+    static const std::string innerCalculationName = "innerCalculation";
+    static const std::string escapeRadiusName = "escapeRadiusSquared";
+    shader.setUniform(innerCalculationName, state.innerCalculation);
+    shader.setUniform("maxIterations", state.maxIterations);
+    shader.setUniform(escapeRadiusName, static_cast<float>(ESCAPE_RADIUS_SQUARED));
+    shader.setUniform("stripeFrequency", state.stripeFrequency);
+    shader.setUniform("stripeIntensity", state.stripeIntensity);
+    shader.setUniform("colorDensity", state.colorDensity);
+    shader.setUniformArray("palette", colors.data(), colors.size());
+    shader.setUniform("paletteSize", static_cast<int>(colors.size()));
+
+    target.clear();
+    target.draw(quad, &shader);
+    target.display();
+    drawn = true;
+}
+
+bool GpuRenderer::present() {
+    bool completed = drawn;
+    drawn = false;
+    return completed;
+}
+
+
+// Match lengths and distances of RFC 1951: the base value of each code and
+// the number of extra bits that follow it.
+constexpr int DEFLATE_LENGTH_BASE[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+constexpr int DEFLATE_LENGTH_EXTRA[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+constexpr int DEFLATE_DISTANCE_BASE[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769,
+    1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+constexpr int DEFLATE_DISTANCE_EXTRA[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+// zlib stream (RFC 1950/1951) fed a piece at a time: LZ77 over a sliding
+// 32 KiB window with fixed Huffman codes. Compressed bytes are appended to
+// `output`, which the caller drains whenever it likes.
+class DeflateStream {
+public:
+    explicit DeflateStream(std::vector<uint8_t>& output);
+
+    void write(const uint8_t* data, size_t size);
+    void finish();
+
+private:
+    static constexpr int WINDOW_SIZE = 1 << 15;
+    static constexpr int HASH_SIZE = 1 << 15;
+    static constexpr int MIN_MATCH = 3;
+    static constexpr int MAX_MATCH = 258;
+    static constexpr int MAX_CHAIN = 32;
+
+    // Encodes the buffered input as one block, all of it when `final` is set
+    // and otherwise up to where a match could still run past the input.
+    void encodeBlock(bool final);
+    void insertHash(size_t index);
+    void writeBits(uint32_t value, int count);
+    // Huffman codes go out most significant bit first.
+    void writeCode(uint32_t code, int length);
+    void writeLiteralOrLength(int symbol);
+
+    std::vector<uint8_t>& output;
+    // Input from absolute position `base` on: up to WINDOW_SIZE bytes of
+    // history before `position`, then what is still to be encoded.
+    std::vector<uint8_t> buffer;
+    long long base = 0;
+    size_t position = 0;
+    std::vector<long long> head;
+    std::vector<long long> previous;
+    uint32_t bitBuffer = 0;
+    int bitCount = 0;
+    uint32_t adlerA = 1;
+    uint32_t adlerB = 0;
+};
+
+DeflateStream::DeflateStream(std::vector<uint8_t>& output)
+    : output(output), head(HASH_SIZE, -1), previous(WINDOW_SIZE, -1) {
+    // CMF: deflate with a 32 KiB window; FLG: no dictionary, check bits.
+    output.push_back(0x78);
+    output.push_back(0x01);
+}
+
+void DeflateStream::write(const uint8_t* data, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        adlerA = (adlerA + data[i]) % 65521;
+        adlerB = (adlerB + adlerA) % 65521;
+    }
+    buffer.insert(buffer.end(), data, data + size);
+    encodeBlock(false);
+
+    if (position > 2 * WINDOW_SIZE) {
+        size_t drop = position - WINDOW_SIZE;
+        buffer.erase(buffer.begin(), buffer.begin() + drop);
+        base += drop;
+        position -= drop;
+    }
+}
+
+void DeflateStream::finish() {
+    encodeBlock(true);
+    if (bitCount > 0) writeBits(0, 8 - bitCount);
+
+    uint32_t adler = (adlerB << 16) | adlerA;
+    for (int shift = 24; shift >= 0; shift -= 8) output.push_back(static_cast<uint8_t>(adler >> shift));
+}
+
+void DeflateStream::insertHash(size_t index) {
+    uint32_t hash = ((buffer[index] << 10) ^ (buffer[index + 1] << 5) ^ buffer[index + 2]) & (HASH_SIZE - 1);
+    long long absolute = base + static_cast<long long>(index);
+    previous[absolute & (WINDOW_SIZE - 1)] = head[hash];
+    head[hash] = absolute;
+}
+
+void DeflateStream::writeBits(uint32_t value, int count) {
+    bitBuffer |= value << bitCount;
+    bitCount += count;
+    while (bitCount >= 8) {
+        output.push_back(static_cast<uint8_t>(bitBuffer));
+        bitBuffer >>= 8;
+        bitCount -= 8;
+    }
+}
+
+void DeflateStream::writeCode(uint32_t code, int length) {
+    uint32_t reversed = 0;
+    for (int i = 0; i < length; i++) reversed |= ((code >> i) & 1) << (length - 1 - i);
+    writeBits(reversed, length);
+}
+
+void DeflateStream::writeLiteralOrLength(int symbol) {
+    struct Code { uint16_t bits; uint8_t length; };
+    // The fixed literal/length code, pre-reversed for writeBits.
+    static const std::array<Code, 288> codes = [] {
+        std::array<Code, 288> table{};
+        for (int s = 0; s < 288; s++) {
+            uint32_t code;
+            int length;
+            if (s < 144) { code = 0x30 + s; length = 8; }
+            else if (s < 256) { code = 0x190 + s - 144; length = 9; }
+            else if (s < 280) { code = s - 256; length = 7; }
+            else { code = 0xC0 + s - 280; length = 8; }
+
+            uint32_t reversed = 0;
+            for (int i = 0; i < length; i++) reversed |= ((code >> i) & 1) << (length - 1 - i);
+            table[s] = { static_cast<uint16_t>(reversed), static_cast<uint8_t>(length) };
+        }
+        return table;
+    }();
+
+    writeBits(codes[symbol].bits, codes[symbol].length);
+}
+
+void DeflateStream::encodeBlock(bool final) {
+    size_t end = final ? buffer.size() : (buffer.size() > MAX_MATCH ? buffer.size() - MAX_MATCH : 0);
+    if (!final && position >= end) return;
+
+    writeBits(final ? 1 : 0, 1);
+    writeBits(1, 2);
+
+    while (position < end) {
+        size_t available = buffer.size() - position;
+        int bestLength = 0;
+        long long bestDistance = 0;
+
+        if (available >= MIN_MATCH) {
+            long long current = base + static_cast<long long>(position);
+            uint32_t hash = ((buffer[position] << 10) ^ (buffer[position + 1] << 5) ^ buffer[position + 2]) & (HASH_SIZE - 1);
+            long long candidate = head[hash];
+            int maxLength = static_cast<int>(std::min<size_t>(available, MAX_MATCH));
+
+            for (int chain = 0; chain < MAX_CHAIN && candidate >= 0 && current - candidate <= WINDOW_SIZE; chain++) {
+                const uint8_t* a = buffer.data() + (candidate - base);
+                const uint8_t* b = buffer.data() + position;
+                int length = 0;
+                while (length < maxLength && a[length] == b[length]) length++;
+                if (length > bestLength) {
+                    bestLength = length;
+                    bestDistance = current - candidate;
+                    if (length == maxLength) break;
+                }
+                long long next = previous[candidate & (WINDOW_SIZE - 1)];
+                // Older entries of the ring may have been overwritten.
+                if (next >= candidate) break;
+                candidate = next;
+            }
+        }
+
+        if (bestLength >= MIN_MATCH) {
+            int code = 28;
+            while (DEFLATE_LENGTH_BASE[code] > bestLength) code--;
+            writeLiteralOrLength(257 + code);
+            writeBits(bestLength - DEFLATE_LENGTH_BASE[code], DEFLATE_LENGTH_EXTRA[code]);
+
+            int distanceCode = 29;
+            while (DEFLATE_DISTANCE_BASE[distanceCode] > bestDistance) distanceCode--;
+            writeCode(distanceCode, 5);
+            writeBits(static_cast<uint32_t>(bestDistance - DEFLATE_DISTANCE_BASE[distanceCode]),
+                DEFLATE_DISTANCE_EXTRA[distanceCode]);
+
+            for (int i = 0; i < bestLength; i++) {
+                if (buffer.size() - position >= MIN_MATCH) insertHash(position);
+                position++;
+            }
+        }
+        else {
+            if (available >= MIN_MATCH) insertHash(position);
+            writeLiteralOrLength(buffer[position]);
+            position++;
+        }
+    }
+
+    writeLiteralOrLength(256);
+}
+
+// Decodes a zlib stream as DeflateStream writes them: stored and fixed-Huffman
+// blocks. Returns false on anything else, a truncated stream or a bad checksum.
+bool inflateStream(const uint8_t* data, size_t size, std::vector<uint8_t>& output) {
+    if (size < 6 || (data[0] & 0x0F) != 8 || ((data[0] << 8) | data[1]) % 31 != 0 || (data[1] & 0x20)) return false;
+
+    size_t position = 2;
+    uint32_t bitBuffer = 0;
+    int bitCount = 0;
+    bool truncated = false;
+    auto readBits = [&](int count) {
+        while (bitCount < count) {
+            if (position == size) {
+                truncated = true;
+                return 0u;
+            }
+            bitBuffer |= static_cast<uint32_t>(data[position++]) << bitCount;
+            bitCount += 8;
+        }
+        uint32_t value = bitBuffer & ((1u << count) - 1);
+        bitBuffer >>= count;
+        bitCount -= count;
+        return value;
+    };
+    // Fixed codes arrive most significant bit first; their lengths tell
+    // literals, lengths and the end of the block apart (RFC 1951 3.2.6).
+    auto readSymbol = [&]() {
+        uint32_t code = 0;
+        for (int length = 1; length <= 9 && !truncated; length++) {
+            code = (code << 1) | readBits(1);
+            if (length == 7 && code < 24) return static_cast<int>(code) + 256;
+            if (length == 8 && code >= 0x30 && code < 0xC0) return static_cast<int>(code) - 0x30;
+            if (length == 8 && code >= 0xC0 && code < 0xC8) return static_cast<int>(code) - 0xC0 + 280;
+            if (length == 9 && code >= 0x190) return static_cast<int>(code) - 0x190 + 144;
+        }
+        return -1;
+    };
+
+    size_t start = output.size();
+    bool final = false;
+    while (!final) {
+        final = readBits(1) != 0;
+        uint32_t type = readBits(2);
+        if (truncated) return false;
+
+        if (type == 0) {
+            bitBuffer = 0;
+            bitCount = 0;
+            if (size - position < 4) return false;
+            uint32_t length = data[position] | (data[position + 1] << 8);
+            uint32_t complement = data[position + 2] | (data[position + 3] << 8);
+            position += 4;
+            if ((length ^ complement) != 0xFFFF || size - position < length) return false;
+            output.insert(output.end(), data + position, data + position + length);
+            position += length;
+            continue;
+        }
+        if (type != 1) return false;
+
+        while (true) {
+            int symbol = readSymbol();
+            if (symbol < 0 || truncated) return false;
+            if (symbol < 256) {
+                output.push_back(static_cast<uint8_t>(symbol));
+                continue;
+            }
+            if (symbol == 256) break;
+            if (symbol > 285) return false;
+
+            int code = symbol - 257;
+            size_t length = DEFLATE_LENGTH_BASE[code] + readBits(DEFLATE_LENGTH_EXTRA[code]);
+            uint32_t distanceCode = 0;
+            for (int i = 0; i < 5; i++) distanceCode = (distanceCode << 1) | readBits(1);
+            if (distanceCode > 29) return false;
+            size_t distance = DEFLATE_DISTANCE_BASE[distanceCode] + readBits(DEFLATE_DISTANCE_EXTRA[distanceCode]);
+            if (truncated || distance > output.size() - start) return false;
+            // Byte by byte, since a match may overlap its own output.
+            for (size_t i = 0; i < length; i++) output.push_back(output[output.size() - distance]);
+        }
+    }
+
+    bitBuffer = 0;
+    bitCount = 0;
+    if (size - position < 4) return false;
+    uint32_t adlerA = 1;
+    uint32_t adlerB = 0;
+    for (size_t i = start; i < output.size(); i++) {
+        adlerA = (adlerA + output[i]) % 65521;
+        adlerB = (adlerB + adlerA) % 65521;
+    }
+    uint32_t expected = (static_cast<uint32_t>(data[position]) << 24) | (data[position + 1] << 16) |
+        (data[position + 2] << 8) | data[position + 3];
+    return expected == ((adlerB << 16) | adlerA);
+}
+
+uint32_t updateCrc32(uint32_t crc, const uint8_t* data, size_t size) {
+    static const std::array<uint32_t, 256> table = [] {
+        std::array<uint32_t, 256> entries{};
+        for (uint32_t n = 0; n < 256; n++) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            entries[n] = c;
+        }
+        return entries;
+    }();
+
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++) crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+// Writes an 8-bit RGB PNG one row at a time; only a couple of rows and the
+// compressor's window are ever held.
+class PngWriter {
+public:
+    PngWriter() : deflate(compressed) {}
+
+    bool open(const std::string& filename, int imageWidth, int imageHeight);
+    // The first three bytes of each `bytesPerPixel`-byte pixel are its RGB.
+    void writeRow(const sf::Uint8* row, int bytesPerPixel);
+    bool close();
+
+private:
+    void writeChunk(const char* type, const uint8_t* data, size_t size);
+    void flushCompressed();
+
+    std::ofstream file;
+    int width = 0;
+    std::vector<uint8_t> previousRow;
+    std::vector<uint8_t> currentRow;
+    std::vector<uint8_t> filtered;
+    std::vector<uint8_t> candidate;
+    std::vector<uint8_t> compressed;
+    DeflateStream deflate;
+};
+
+inline void appendBigEndian(std::vector<uint8_t>& bytes, uint32_t value) {
+    for (int shift = 24; shift >= 0; shift -= 8) bytes.push_back(static_cast<uint8_t>(value >> shift));
+}
+
+bool PngWriter::open(const std::string& filename, int imageWidth, int imageHeight) {
+    file.open(filename, std::ios::binary);
+    if (!file) return false;
+
+    width = imageWidth;
+    previousRow.assign(width * 3, 0);
+    currentRow.resize(width * 3);
+    filtered.resize(width * 3 + 1);
+    candidate.resize(width * 3 + 1);
+
+    static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    file.write(reinterpret_cast<const char*>(signature), sizeof(signature));
+
+    std::vector<uint8_t> header;
+    appendBigEndian(header, imageWidth);
+    appendBigEndian(header, imageHeight);
+    // 8 bits per channel, RGB, deflate, adaptive filtering, no interlace.
+    header.insert(header.end(), { 8, 2, 0, 0, 0 });
+    writeChunk("IHDR", header.data(), header.size());
+    return static_cast<bool>(file);
+}
+
+void PngWriter::writeRow(const sf::Uint8* row, int bytesPerPixel) {
+    for (int x = 0; x < width; x++) {
+        std::copy(row + x * bytesPerPixel, row + x * bytesPerPixel + 3, currentRow.begin() + x * 3);
+    }
+
+    // The usual heuristic: the filter whose output has the smallest sum of
+    // absolute values as signed bytes.
+    long long bestCost = -1;
+    for (uint8_t filter = 0; filter <= 4; filter++) {
+        candidate[0] = filter;
+        long long cost = 0;
+        for (int i = 0; i < width * 3; i++) {
+            int left = (i >= 3) ? currentRow[i - 3] : 0;
+            int up = previousRow[i];
+            int upLeft = (i >= 3) ? previousRow[i - 3] : 0;
+            int predictor = 0;
+            switch (filter) {
+            case 1: predictor = left; break;
+            case 2: predictor = up; break;
+            case 3: predictor = (left + up) / 2; break;
+            case 4: {
+                int estimate = left + up - upLeft;
+                int toLeft = std::abs(estimate - left);
+                int toUp = std::abs(estimate - up);
+                int toUpLeft = std::abs(estimate - upLeft);
+                predictor = (toLeft <= toUp && toLeft <= toUpLeft) ? left : (toUp <= toUpLeft ? up : upLeft);
+                break;
+            }
+            }
+            uint8_t value = static_cast<uint8_t>(currentRow[i] - predictor);
+            candidate[i + 1] = value;
+            cost += (value < 128) ? value : 256 - value;
+        }
+        if (bestCost < 0 || cost < bestCost) {
+            bestCost = cost;
+            filtered.swap(candidate);
+        }
+    }
+
+    deflate.write(filtered.data(), filtered.size());
+    previousRow.swap(currentRow);
+    flushCompressed();
+}
+
+bool PngWriter::close() {
+    deflate.finish();
+    flushCompressed();
+    if (!compressed.empty()) writeChunk("IDAT", compressed.data(), compressed.size());
+    writeChunk("IEND", nullptr, 0);
+    file.close();
+    return !file.fail();
+}
+
+void PngWriter::flushCompressed() {
+    constexpr size_t CHUNK_SIZE = 1 << 16;
+    if (compressed.size() < CHUNK_SIZE) return;
+    writeChunk("IDAT", compressed.data(), compressed.size());
+    compressed.clear();
+}
+
+void PngWriter::writeChunk(const char* type, const uint8_t* data, size_t size) {
+    std::vector<uint8_t> length;
+    appendBigEndian(length, static_cast<uint32_t>(size));
+    file.write(reinterpret_cast<const char*>(length.data()), 4);
+    file.write(type, 4);
+    if (size > 0) file.write(reinterpret_cast<const char*>(data), size);
+
+    uint32_t crc = updateCrc32(0, reinterpret_cast<const uint8_t*>(type), 4);
+    crc = updateCrc32(crc, data, size);
+    std::vector<uint8_t> trailer;
+    appendBigEndian(trailer, crc);
+    file.write(reinterpret_cast<const char*>(trailer.data()), 4);
+}
+
+void saveScreenshot(const sf::Texture& texture, const RenderState& state) {
+    sf::Image screenshot = texture.copyToImage();
+
+    time_t now = time(0);
+    tm timeinfo;
+
+#ifdef _WIN32
+    localtime_s(&timeinfo, &now);
+#else
+    tm* temp = localtime(&now);
+    if (temp) timeinfo = *temp;
+#endif
+
+    std::stringstream filename;
+    filename << "fractal_" << (state.showJulia ? "julia_" : "mandelbrot_")
+        << std::fixed << std::setprecision(6) << state.viewportX << "_" << state.viewportY
+        << "_zoom_" << std::setprecision(2) << (3.0 / state.viewportX)
+        << now << ".png";
+
+    screenshot.saveToFile(filename.str());
+    std::cout << "Screenshot saved: " << filename.str() << std::endl;
+}
+
+// Prints the state as "key = value" lines, which is also the job format of
+// the headless batch mode, so a pasted dump re-renders the same view.
+void outputStateDetails(const RenderState& state) {
+    std::stringstream details;
+    details << std::setprecision(17);
+
+    details << "--- State Details ---" << '\n';
+    details << "x = " << formatHighPrecision(getCenterX(state), getPositionDigits(state)) << '\n';
+    details << "y = " << formatHighPrecision(getCenterY(state), getPositionDigits(state)) << '\n';
+    details << "zoom = " << state.viewportHeight << '\n';
+    details << "aspect = " << state.aspectRatio << '\n';
+    details << "cd = " << state.colorDensity << '\n';
+
+    details << "maxit = " << state.maxIterations << '\n';
+    details << "autoit = " << state.autoIterations << '\n';
+    details << "type = " << state.fractalType << '\n';
+    details << "julia = " << state.showJulia << '\n';
+    details << "jx = " << state.juliaX << '\n';
+    details << "jy = " << state.juliaY << '\n';
+    details << "palette = " << state.colorScheme << '\n';
+    details << "inner = " << state.innerCalculation << '\n';
+    details << "stripes = " << state.stripes << '\n';
+    details << "sf = " << state.stripeFrequency << '\n';
+    details << "si = " << state.stripeIntensity << '\n';
+    details << "aa = " << state.antiAliasing << '\n';
+    details << "aasamples = " << state.antiAliasingSamples << '\n';
+    details << "histogram = " << state.histogramColoring << '\n';
+    details << "fill = " << (state.solidFill == SolidFill::Off ? "off" :
+        state.solidFill == SolidFill::Interior ? "interior" : "bands") << '\n';
+    std::cout << details.str();
+}
+
+
+std::string makeExportName(const RenderState& state, const char* kind, int width, int height) {
+    time_t now = time(0);
+
+    std::stringstream name;
+    name << "fractal_" << (state.showJulia ? "julia_" : "mandelbrot_")
+        << std::fixed << std::setprecision(6) << state.viewportX << "_" << state.viewportY
+        << "_zoom_" << std::setprecision(2) << (3.0 / state.viewportX)
+        << "_" << kind << "_" << width << "x" << height << "_"
+        << now;
+    return name.str();
+}
+
+// Renders `width` x `height` pixels band by band and hands each finished row
+// to `consumeRow`, so only EXPORT_BAND_HEIGHT rows are ever in memory.
+template <typename RowConsumer>
+KernelCounters renderBands(RenderThreadPool& pool, const RenderState& state, int width, int height, RowConsumer consumeRow,
+    bool reportProgress = true) {
+    BandRenderer renderer(pool, state, width, height);
+    std::vector<sf::Uint8> band(static_cast<size_t>(width) * EXPORT_BAND_HEIGHT * 4);
+
+    int reportedPercent = 0;
+    for (int startY = 0; startY < height; startY += EXPORT_BAND_HEIGHT) {
+        int endY = std::min(startY + EXPORT_BAND_HEIGHT, height);
+        renderer.render(startY, endY, band.data());
+        for (int y = startY; y < endY; y++) {
+            consumeRow(band.data() + static_cast<size_t>(y - startY) * width * 4);
+        }
+
+        int percent = static_cast<int>(100LL * endY / height);
+        if (reportProgress && (percent >= reportedPercent + 10 || endY == height)) {
+            std::cout << "  " << percent << "%" << std::endl;
+            reportedPercent = percent;
+        }
+    }
+    return renderer.getCounters();
+}
+
+void saveHighResScreenshot(RenderThreadPool& pool, const RenderState& state, int width, int height, int scale) {
+    int hiResWidth = width * scale;
+    int hiResHeight = height * scale;
+
+    std::cout << "Rendering high-resolution screenshot (" << hiResWidth << "x" << hiResHeight << ")..." << std::endl;
+
+    std::string filename = makeExportName(state, "hires", hiResWidth, hiResHeight) + ".png";
+    PngWriter png;
+    if (!png.open(filename, hiResWidth, hiResHeight)) {
+        std::cout << "Could not create " << filename << std::endl;
+        return;
+    }
+
+    renderBands(pool, state, hiResWidth, hiResHeight, [&](const sf::Uint8* row) { png.writeRow(row, 4); });
+
+    if (png.close()) std::cout << "High-resolution screenshot saved: " << filename << std::endl;
+    else std::cout << "Failed writing " << filename << std::endl;
+}
+
+// Builds a DeepZoom pyramid from rows arriving top to bottom. Every level
+// keeps one row of PYRAMID_TILE_SIZE-high tiles, writes it once full, and
+// 2x2-averages row pairs into the level below.
+class DeepZoomWriter {
+public:
+    DeepZoomWriter(const std::string& tileDirectory, int width, int height);
+
+    // `row` holds `bytesPerPixel` bytes per pixel at full resolution.
+    void addRow(const sf::Uint8* row, int bytesPerPixel);
+    bool finish();
+
+    static std::string describe(int width, int height);
+
+private:
+    struct Level {
+        int width = 0;
+        int height = 0;
+        int rowsReceived = 0;
+        int tileRow = 0;
+        int bufferedRows = 0;
+        // RGB rows of the current tile row.
+        std::vector<uint8_t> rows;
+        // First row of a pair still waiting for its partner.
+        std::vector<uint8_t> pending;
+        bool hasPending = false;
+    };
+
+    void addLevelRow(int level, const uint8_t* rgb);
+    void reduceInto(int level, const uint8_t* upper, const uint8_t* lower);
+    void flushTiles(int level);
+
+    std::string tileDirectory;
+    std::vector<Level> levels;
+    std::vector<uint8_t> rgbRow;
+    bool ok = true;
+};
+
+DeepZoomWriter::DeepZoomWriter(const std::string& tileDirectory, int width, int height)
+    : tileDirectory(tileDirectory), rgbRow(static_cast<size_t>(width) * 3) {
+    int maxLevel = 0;
+    while ((1LL << maxLevel) < std::max(width, height)) maxLevel++;
+
+    levels.resize(maxLevel + 1);
+    for (int level = maxLevel; level >= 0; level--) {
+        int shift = maxLevel - level;
+        Level& entry = levels[level];
+        entry.width = static_cast<int>(((1LL << shift) - 1 + width) >> shift);
+        entry.height = static_cast<int>(((1LL << shift) - 1 + height) >> shift);
+        entry.rows.resize(static_cast<size_t>(entry.width) * 3 * std::min(PYRAMID_TILE_SIZE, entry.height));
+        if (level > 0) entry.pending.resize(static_cast<size_t>(entry.width) * 3);
+
+        std::error_code error;
+        std::filesystem::create_directories(tileDirectory + "/" + std::to_string(level), error);
+        if (error) ok = false;
+    }
+}
+
+std::string DeepZoomWriter::describe(int width, int height) {
+    std::stringstream xml;
+    xml << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        << "<Image xmlns=\"http://schemas.microsoft.com/deepzoom/2008\" Format=\"png\" Overlap=\"0\" TileSize=\""
+        << PYRAMID_TILE_SIZE << "\">\n"
+        << "  <Size Width=\"" << width << "\" Height=\"" << height << "\"/>\n"
+        << "</Image>\n";
+    return xml.str();
+}
+
+void DeepZoomWriter::addRow(const sf::Uint8* row, int bytesPerPixel) {
+    for (size_t x = 0; x < rgbRow.size() / 3; x++) {
+        std::copy(row + x * bytesPerPixel, row + x * bytesPerPixel + 3, rgbRow.begin() + x * 3);
+    }
+    addLevelRow(static_cast<int>(levels.size()) - 1, rgbRow.data());
+}
+
+void DeepZoomWriter::addLevelRow(int level, const uint8_t* rgb) {
+    Level& entry = levels[level];
+    size_t rowBytes = static_cast<size_t>(entry.width) * 3;
+    std::copy(rgb, rgb + rowBytes, entry.rows.begin() + entry.bufferedRows * rowBytes);
+    entry.bufferedRows++;
+    entry.rowsReceived++;
+    if (entry.bufferedRows == PYRAMID_TILE_SIZE || entry.rowsReceived == entry.height) flushTiles(level);
+
+    if (level == 0) return;
+    if (entry.hasPending) {
+        entry.hasPending = false;
+        reduceInto(level, entry.pending.data(), rgb);
+    }
+    else if (entry.rowsReceived == entry.height) {
+        // An odd last row pairs with itself.
+        reduceInto(level, rgb, rgb);
+    }
+    else {
+        std::copy(rgb, rgb + rowBytes, entry.pending.begin());
+        entry.hasPending = true;
+    }
+}
+
+void DeepZoomWriter::reduceInto(int level, const uint8_t* upper, const uint8_t* lower) {
+    int upperWidth = levels[level].width;
+    int lowerWidth = levels[level - 1].width;
+    std::vector<uint8_t> reduced(static_cast<size_t>(lowerWidth) * 3);
+
+    for (int x = 0; x < lowerWidth; x++) {
+        int left = 2 * x;
+        int right = std::min(left + 1, upperWidth - 1);
+        for (int c = 0; c < 3; c++) {
+            int sum = upper[left * 3 + c] + upper[right * 3 + c] + lower[left * 3 + c] + lower[right * 3 + c];
+            reduced[x * 3 + c] = static_cast<uint8_t>((sum + 2) / 4);
+        }
+    }
+    addLevelRow(level - 1, reduced.data());
+}
+
+void DeepZoomWriter::flushTiles(int level) {
+    Level& entry = levels[level];
+    size_t rowBytes = static_cast<size_t>(entry.width) * 3;
+
+    for (int column = 0; column * PYRAMID_TILE_SIZE < entry.width; column++) {
+        int tileX = column * PYRAMID_TILE_SIZE;
+        int tileWidth = std::min(PYRAMID_TILE_SIZE, entry.width - tileX);
+        std::string filename = tileDirectory + "/" + std::to_string(level) + "/"
+            + std::to_string(column) + "_" + std::to_string(entry.tileRow) + ".png";
+
+        PngWriter png;
+        if (!png.open(filename, tileWidth, entry.bufferedRows)) {
+            ok = false;
+            continue;
+        }
+        for (int y = 0; y < entry.bufferedRows; y++) {
+            png.writeRow(entry.rows.data() + y * rowBytes + tileX * 3, 3);
+        }
+        if (!png.close()) ok = false;
+    }
+
+    entry.tileRow++;
+    entry.bufferedRows = 0;
+}
+
+bool DeepZoomWriter::finish() {
+    for (const Level& entry : levels) {
+        if (entry.rowsReceived != entry.height) return false;
+    }
+    return ok;
+}
+
+void saveDeepZoomPyramid(RenderThreadPool& pool, const RenderState& state, int width, int height, int scale) {
+    int fullWidth = width * scale;
+    int fullHeight = height * scale;
+
+    std::cout << "Rendering DeepZoom pyramid (" << fullWidth << "x" << fullHeight << ")..." << std::endl;
+
+    std::string name = makeExportName(state, "pyramid", fullWidth, fullHeight);
+    DeepZoomWriter pyramid(name + "_files", fullWidth, fullHeight);
+
+    renderBands(pool, state, fullWidth, fullHeight, [&](const sf::Uint8* row) { pyramid.addRow(row, 4); });
+
+    std::ofstream descriptor(name + ".dzi");
+    descriptor << DeepZoomWriter::describe(fullWidth, fullHeight);
+    descriptor.close();
+
+    if (pyramid.finish() && descriptor) std::cout << "DeepZoom pyramid saved: " << name << ".dzi" << std::endl;
+    else std::cout << "Failed writing the pyramid " << name << std::endl;
+}
+
+// Wire format of a RenderState between a coordinator and its workers; the
+// view center travels with all its limbs, so workers render the exact view.
+sf::Packet& operator<<(sf::Packet& packet, const HighPrecision& value) {
+    for (uint32_t limb : value.limbs) packet << static_cast<sf::Uint32>(limb);
+    return packet;
+}
+
+sf::Packet& operator>>(sf::Packet& packet, HighPrecision& value) {
+    for (uint32_t& limb : value.limbs) {
+        sf::Uint32 received = 0;
+        packet >> received;
+        limb = received;
+    }
+    return packet;
+}
+
+sf::Packet& operator<<(sf::Packet& packet, const RenderState& state) {
+    return packet << state.viewportX << state.viewportY << state.viewportHeight
+        << static_cast<sf::Int32>(state.maxIterations) << state.colorDensity << state.showJulia
+        << state.juliaX << state.juliaY << static_cast<sf::Int32>(state.colorScheme) << state.autoIterations
+        << static_cast<sf::Int32>(state.fractalType) << state.stripes << state.stripeFrequency
+        << state.stripeIntensity << state.innerCalculation << state.antiAliasing
+        << static_cast<sf::Int32>(state.antiAliasingSamples) << static_cast<sf::Int32>(state.solidFill)
+        << state.viewportXLow << state.viewportYLow << state.histogramColoring << state.aspectRatio;
+}
+
+// Leaves the packet invalid when a field is out of range.
+sf::Packet& operator>>(sf::Packet& packet, RenderState& state) {
+    sf::Int32 maxIterations = 0;
+    sf::Int32 colorScheme = 0;
+    sf::Int32 fractalType = 0;
+    sf::Int32 antiAliasingSamples = 0;
+    sf::Int32 solidFill = 0;
+    packet >> state.viewportX >> state.viewportY >> state.viewportHeight >> maxIterations >> state.colorDensity
+        >> state.showJulia >> state.juliaX >> state.juliaY >> colorScheme >> state.autoIterations >> fractalType
+        >> state.stripes >> state.stripeFrequency >> state.stripeIntensity >> state.innerCalculation
+        >> state.antiAliasing >> antiAliasingSamples >> solidFill >> state.viewportXLow >> state.viewportYLow
+        >> state.histogramColoring >> state.aspectRatio;
+
+    if (maxIterations < 1 || colorScheme < 0 || colorScheme >= static_cast<sf::Int32>(PALETTES.size()) ||
+        (fractalType != FRACTAL_MANDELBROT && fractalType != FRACTAL_BURNING_SHIP) ||
+        antiAliasingSamples < 1 || antiAliasingSamples > MAX_ANTI_ALIASING_SAMPLES || solidFill < 0 || solidFill > 2 ||
+        !(state.viewportHeight >= MIN_VIEWPORT_HEIGHT) ||
+        !(state.aspectRatio > 0 && std::isfinite(state.aspectRatio))) {
+        // Reading past the end is what marks an SFML packet invalid.
+        sf::Uint8 end;
+        while (packet >> end) {}
+        return packet;
+    }
+    state.maxIterations = maxIterations;
+    state.colorScheme = colorScheme;
+    state.fractalType = fractalType;
+    state.antiAliasingSamples = antiAliasingSamples;
+    state.solidFill = static_cast<SolidFill>(solidFill);
+    return packet;
+}
+
+// Coordinator side of a distributed export. Each band job is a packet of
+// (export id, band, state, width, height, startY, endY); the worker answers
+// with (export id, band, zlib-compressed RGB rows).
+class RenderCluster {
+public:
+    // Connects to every "host[:port]" of `addresses`, reporting and skipping
+    // the ones that don't answer. Returns false when none does.
+    bool connect(const std::vector<std::string>& addresses);
+
+    // renderBands with the bands farmed out to the workers, up to
+    // WORKER_BANDS_IN_FLIGHT each. A worker that disconnects, sends a bad band or
+    // stalls for WORKER_TIMEOUT_SECONDS is dropped and its bands are queued again;
+    // with no worker left the local pool renders what remains.
+    template <typename RowConsumer>
+    void render(RenderThreadPool& pool, const RenderState& state, int width, int height, RowConsumer consumeRow,
+        bool reportProgress = true);
+
+private:
+    struct Worker {
+        std::string address;
+        std::unique_ptr<sf::TcpSocket> socket;
+        // Bands sent and not yet answered, oldest first.
+        std::deque<int> bands;
+        std::chrono::high_resolution_clock::time_point lastActivity;
+        int completed = 0;
+        bool alive = true;
+    };
+
+    bool sendBand(Worker& worker, const RenderState& state, int width, int height, int band);
+    bool receiveBand(Worker& worker, int width, int height, std::map<int, std::vector<uint8_t>>& finished);
+    void dropWorker(Worker& worker, std::deque<int>& pending, const char* reason);
+
+    std::vector<Worker> workers;
+    sf::SocketSelector selector;
+    sf::Uint32 exportId = 0;
+};
+
+inline int getBandRows(int band, int height) {
+    return std::min(DISTRIBUTED_BAND_HEIGHT, height - band * DISTRIBUTED_BAND_HEIGHT);
+}
+
+bool RenderCluster::connect(const std::vector<std::string>& addresses) {
+    for (const std::string& address : addresses) {
+        size_t colon = address.rfind(':');
+        std::string host = address.substr(0, colon);
+        int port = colon == std::string::npos ? DEFAULT_WORKER_PORT : std::atoi(address.c_str() + colon + 1);
+
+        Worker worker;
+        worker.address = address;
+        worker.socket = std::make_unique<sf::TcpSocket>();
+        if (port <= 0 || port > 65535 ||
+            worker.socket->connect(sf::IpAddress(host), static_cast<unsigned short>(port), sf::seconds(5)) != sf::Socket::Done) {
+            std::cerr << "Worker " << address << " is not reachable" << std::endl;
+            continue;
+        }
+        selector.add(*worker.socket);
+        workers.push_back(std::move(worker));
+    }
+
+    std::cout << "Connected to " << workers.size() << " of " << addresses.size() << " worker(s)" << std::endl;
+    return !workers.empty();
+}
+
+bool RenderCluster::sendBand(Worker& worker, const RenderState& state, int width, int height, int band) {
+    int startY = band * DISTRIBUTED_BAND_HEIGHT;
+    sf::Packet packet;
+    packet << exportId << static_cast<sf::Int32>(band) << state << static_cast<sf::Int32>(width)
+        << static_cast<sf::Int32>(height) << static_cast<sf::Int32>(startY)
+        << static_cast<sf::Int32>(startY + getBandRows(band, height));
+    worker.bands.push_back(band);
+    worker.lastActivity = std::chrono::high_resolution_clock::now();
+    return worker.socket->send(packet) == sf::Socket::Done;
+}
+
+bool RenderCluster::receiveBand(Worker& worker, int width, int height,
+    std::map<int, std::vector<uint8_t>>& finished) {
+    sf::Packet packet;
+    if (worker.socket->receive(packet) != sf::Socket::Done) return false;
+
+    sf::Uint32 receivedExport = 0;
+    sf::Int32 band = 0;
+    std::string compressed;
+    if (!(packet >> receivedExport >> band >> compressed) || receivedExport != exportId ||
+        worker.bands.empty() || band != worker.bands.front()) {
+        return false;
+    }
+
+    std::vector<uint8_t> rgb;
+    if (!inflateStream(reinterpret_cast<const uint8_t*>(compressed.data()), compressed.size(), rgb) ||
+        rgb.size() != static_cast<size_t>(width) * getBandRows(band, height) * 3) {
+        return false;
+    }
+
+    finished[band] = std::move(rgb);
+    worker.bands.pop_front();
+    worker.completed++;
+    worker.lastActivity = std::chrono::high_resolution_clock::now();
+    return true;
+}
+
+void RenderCluster::dropWorker(Worker& worker, std::deque<int>& pending, const char* reason) {
+    std::cerr << "  worker " << worker.address << " " << reason << ", retrying its " << worker.bands.size()
+        << " band(s)" << std::endl;
+    worker.alive = false;
+    selector.remove(*worker.socket);
+    worker.socket->disconnect();
+    pending.insert(pending.end(), worker.bands.begin(), worker.bands.end());
+    std::sort(pending.begin(), pending.end());
+    worker.bands.clear();
+}
+
+template <typename RowConsumer>
+void RenderCluster::render(RenderThreadPool& pool, const RenderState& state, int width, int height,
+    RowConsumer consumeRow, bool reportProgress) {
+    exportId++;
+    int bandCount = (height + DISTRIBUTED_BAND_HEIGHT - 1) / DISTRIBUTED_BAND_HEIGHT;
+    std::deque<int> pending;
+    for (int band = 0; band < bandCount; band++) pending.push_back(band);
+    // Bands are handed out at most this far ahead of the next one the
+    // consumer needs, which bounds the finished bands waiting for it.
+    int lookahead = 2 * WORKER_BANDS_IN_FLIGHT * static_cast<int>(workers.size());
+    std::map<int, std::vector<uint8_t>> finished;
+    std::unique_ptr<BandRenderer> local;
+    std::vector<sf::Uint8> localBand;
+    std::vector<sf::Uint8> row(static_cast<size_t>(width) * 4, 255);
+    int localBands = 0;
+    int reportedPercent = 0;
+
+    for (int nextBand = 0;;) {
+        for (auto done = finished.find(nextBand); done != finished.end(); done = finished.find(nextBand)) {
+            const uint8_t* rgb = done->second.data();
+            for (int y = 0; y < getBandRows(nextBand, height); y++) {
+                for (int x = 0; x < width; x++, rgb += 3) std::copy(rgb, rgb + 3, row.begin() + x * 4);
+                consumeRow(row.data());
+            }
+            finished.erase(done);
+            nextBand++;
+
+            int percent = static_cast<int>(100LL * nextBand / bandCount);
+            if (reportProgress && (percent >= reportedPercent + 10 || nextBand == bandCount)) {
+                std::cout << "  " << percent << "%" << std::endl;
+                reportedPercent = percent;
+            }
+        }
+        if (nextBand == bandCount) break;
+
+        bool anyAlive = false;
+        for (Worker& worker : workers) {
+            while (worker.alive && static_cast<int>(worker.bands.size()) < WORKER_BANDS_IN_FLIGHT &&
+                !pending.empty() && pending.front() < nextBand + lookahead) {
+                int band = pending.front();
+                pending.pop_front();
+                if (!sendBand(worker, state, width, height, band)) dropWorker(worker, pending, "stopped accepting work");
+            }
+            anyAlive |= worker.alive;
+        }
+
+        if (!anyAlive) {
+            // Every band not finished is queued now, the next one first.
+            if (!local) {
+                std::cerr << "  no worker left, rendering the rest locally" << std::endl;
+                local = std::make_unique<BandRenderer>(pool, state, width, height);
+            }
+            int band = pending.front();
+            pending.pop_front();
+            int startY = band * DISTRIBUTED_BAND_HEIGHT;
+            int rows = getBandRows(band, height);
+            localBand.resize(static_cast<size_t>(width) * rows * 4);
+            local->render(startY, startY + rows, localBand.data());
+
+            std::vector<uint8_t>& rgb = finished[band];
+            rgb.resize(static_cast<size_t>(width) * rows * 3);
+            for (size_t i = 0; i < static_cast<size_t>(width) * rows; i++) {
+                std::copy(localBand.begin() + i * 4, localBand.begin() + i * 4 + 3, rgb.begin() + i * 3);
+            }
+            localBands++;
+            continue;
+        }
+
+        if (selector.wait(sf::seconds(1))) {
+            for (Worker& worker : workers) {
+                if (worker.alive && selector.isReady(*worker.socket) && !receiveBand(worker, width, height, finished)) {
+                    dropWorker(worker, pending, "failed");
+                }
+            }
+        }
+        auto now = std::chrono::high_resolution_clock::now();
+        for (Worker& worker : workers) {
+            if (worker.alive && !worker.bands.empty() && now - worker.lastActivity > std::chrono::seconds(WORKER_TIMEOUT_SECONDS)) {
+                dropWorker(worker, pending, "timed out");
+            }
+        }
+    }
+
+    std::stringstream summary;
+    summary << "  bands:";
+    for (Worker& worker : workers) {
+        summary << " " << worker.address << " " << worker.completed << (worker.alive ? "" : " (dropped)") << ",";
+        worker.completed = 0;
+    }
+    summary << " local " << localBands;
+    if (reportProgress) std::cout << summary.str() << std::endl;
+}
+
+// Renders the bands of one coordinator connection until it closes. The band
+// renderer, and with it a deep zoom's reference orbit, carries over between
+// the bands of an export.
+void serveCoordinator(RenderThreadPool& pool, sf::TcpSocket& coordinator) {
+    std::unique_ptr<BandRenderer> renderer;
+    sf::Uint32 rendererExport = 0;
+    std::vector<sf::Uint8> band;
+    std::vector<uint8_t> rgb;
+    sf::Packet packet;
+
+    while (coordinator.receive(packet) == sf::Socket::Done) {
+        sf::Uint32 exportId = 0;
+        sf::Int32 bandIndex = 0;
+        RenderState state;
+        sf::Int32 width = 0;
+        sf::Int32 height = 0;
+        sf::Int32 startY = 0;
+        sf::Int32 endY = 0;
+        if (!(packet >> exportId >> bandIndex >> state >> width >> height >> startY >> endY) ||
+            width <= 0 || height <= 0 || startY < 0 || endY <= startY || endY > height ||
+            static_cast<long long>(width) * (endY - startY) > 1LL << 28) {
+            std::cerr << "Malformed band job, closing the connection" << std::endl;
+            return;
+        }
+
+        if (!renderer || exportId != rendererExport) {
+            renderer = std::make_unique<BandRenderer>(pool, state, width, height);
+            rendererExport = exportId;
+        }
+        int rows = endY - startY;
+        band.resize(static_cast<size_t>(width) * rows * 4);
+        renderer->render(startY, endY, band.data());
+
+        rgb.resize(static_cast<size_t>(width) * rows * 3);
+        for (size_t i = 0; i < static_cast<size_t>(width) * rows; i++) {
+            std::copy(band.begin() + i * 4, band.begin() + i * 4 + 3, rgb.begin() + i * 3);
+        }
+        std::vector<uint8_t> compressed;
+        DeflateStream deflate(compressed);
+        deflate.write(rgb.data(), rgb.size());
+        deflate.finish();
+
+        sf::Packet reply;
+        reply << exportId << bandIndex << std::string(compressed.begin(), compressed.end());
+        if (coordinator.send(reply) != sf::Socket::Done) return;
+    }
+}
+
+// Worker mode: serves coordinators one at a time, forever.
+int runWorker(unsigned short port) {
+    sf::TcpListener listener;
+    if (listener.listen(port) != sf::Socket::Done) {
+        std::cerr << "Could not listen on port " << port << std::endl;
+        return 1;
+    }
+
+    RenderThreadPool pool(NUM_THREADS);
+    std::cout << "Worker listening on port " << port << " with " << NUM_THREADS << " threads ("
+        << getSimdLevelName(SIMD_LEVEL) << " kernel)" << std::endl;
+
+    while (true) {
+        sf::TcpSocket coordinator;
+        if (listener.accept(coordinator) != sf::Socket::Done) continue;
+        std::cout << "Coordinator " << coordinator.getRemoteAddress().toString() << " connected" << std::endl;
+        serveCoordinator(pool, coordinator);
+        std::cout << "Coordinator disconnected" << std::endl;
+    }
+}
+
+void writeInfoString(std::string& info, const RenderState& state, int height) {
+    info.clear();
+    appendFormatted(info, "Mode: %s\n", state.showJulia ? "Julia" : "Mandelbrot");
+    appendFormatted(info, "Position: (%.10f, %.10f)\n", state.viewportX, state.viewportY);
+    appendFormatted(info, "Zoom: %.2fx\n", 3.0 / state.viewportHeight);
+    appendFormatted(info, "Precision: %s\n", getPrecisionName(selectPrecision(state, height)));
+    appendFormatted(info, "Iterations: %d%s\n", state.maxIterations, state.autoIterations ? " (auto)" : "");
+    if (state.antiAliasing) {
+        appendFormatted(info, "Anti-aliasing: %dx%d on edges\n", state.antiAliasingSamples, state.antiAliasingSamples);
+    }
+    if (state.solidFill != SolidFill::Off) {
+        appendFormatted(info, "Solid fill: %s\n", state.solidFill == SolidFill::Interior ? "interior" : "bands");
+    }
+    if (usesHistogramColoring(state)) {
+        info += "Coloring: histogram\n";
+    }
+
+    if (state.showJulia) {
+        appendFormatted(info, "Julia seed: (%.6f, %.6f)\n", state.juliaX, state.juliaY);
+    }
+}
+
+void adjustIterations(RenderState& state) {
+    if (state.autoIterations) {
+        double zoomFactor = 3.0 / state.viewportHeight;
+        state.maxIterations = std::min(10000, static_cast<int>(100 * log10(1 + zoomFactor)));
+        state.maxIterations = std::max(100, state.maxIterations);
+    }
+}
+
+// Scales the view by `factor` around the point under pixel (pixelX, pixelY)
+// of a `width` x `height` window. The center moves by a whole number of old
+// pixels times (1 - factor), which for the wheel's 0.5 and 2 keeps the new
+// pixel grid on the old samples.
+void zoomAtPixel(RenderState& state, int width, int height, int pixelX, int pixelY, double factor) {
+    double pixelWidth = state.getViewportWidth() / width;
+    double pixelHeight = state.viewportHeight / height;
+
+    if (state.viewportHeight * factor < MIN_VIEWPORT_HEIGHT || state.viewportHeight * factor > MAX_VIEWPORT_HEIGHT) {
+        return;
+    }
+
+    moveView(state, (pixelX - width / 2) * pixelWidth * (1 - factor),
+        (pixelY - height / 2) * pixelHeight * (1 - factor));
+    state.viewportHeight *= factor;
+}
+
+// A render of the headless batch mode: the view plus the image to write.
+struct BatchJob {
+    RenderState state;
+    int width = WINDOW_WIDTH;
+    // 0 derives the height from the width and ASPECT_RATIO.
+    int height = 0;
+    // Empty picks a name like the screenshots do; ".dzi" writes a pyramid.
+    std::string output;
+    // Zoom videos only: frames spent getting here from the previous keyframe.
+    int frames = 60;
+    double fps = 60;
+};
+
+bool parseNumber(const std::string& text, double& value) {
+    char* end = nullptr;
+    value = std::strtod(text.c_str(), &end);
+    return !text.empty() && *end == '\0' && std::isfinite(value);
+}
+
+bool parseFlag(const std::string& text, bool& value) {
+    if (text == "1" || text == "true" || text == "on") value = true;
+    else if (text == "0" || text == "false" || text == "off") value = false;
+    else return false;
+    return true;
+}
+
+// Applies one "key = value" setting, using the keys outputStateDetails prints
+// plus width, height and output.
+bool applyJobSetting(BatchJob& job, const std::string& key, const std::string& value) {
+    RenderState& state = job.state;
+    double number = 0;
+    bool flag = false;
+
+    if (key == "x" || key == "y") {
+        HighPrecision center;
+        if (!parseHighPrecision(value, center)) {
+            // Scientific notation and the like still work, at double precision.
+            if (!parseNumber(value, number) || std::fabs(number) > MAX_PLANE_COORDINATE) return false;
+            center = HighPrecision(number);
+        }
+        if (std::fabs(center.toDouble()) > MAX_PLANE_COORDINATE) return false;
+        if (key == "x") setViewCenter(state, center, getCenterY(state));
+        else setViewCenter(state, getCenterX(state), center);
+        return true;
+    }
+    if (key == "fill") {
+        if (value == "off") state.solidFill = SolidFill::Off;
+        else if (value == "interior") state.solidFill = SolidFill::Interior;
+        else if (value == "bands") state.solidFill = SolidFill::Bands;
+        else return false;
+        return true;
+    }
+    if (key == "output") {
+        job.output = value;
+        return !value.empty();
+    }
+
+    if (key == "julia" || key == "autoit" || key == "inner" || key == "stripes" || key == "aa" ||
+        key == "histogram") {
+        if (!parseFlag(value, flag)) return false;
+        if (key == "julia") state.showJulia = flag;
+        else if (key == "autoit") state.autoIterations = flag;
+        else if (key == "inner") state.innerCalculation = flag;
+        else if (key == "stripes") state.stripes = flag;
+        else if (key == "histogram") state.histogramColoring = flag;
+        else state.antiAliasing = flag;
+        return true;
+    }
+
+    if (!parseNumber(value, number)) return false;
+    if (key == "zoom") {
+        if (number < MIN_VIEWPORT_HEIGHT || number > MAX_VIEWPORT_HEIGHT) return false;
+        state.viewportHeight = number;
+    }
+    else if (key == "aspect") {
+        if (number <= 0) return false;
+        state.aspectRatio = number;
+    }
+    else if (key == "cd") state.colorDensity = static_cast<float>(number);
+    else if (key == "maxit") {
+        if (number < 1) return false;
+        state.maxIterations = static_cast<int>(number);
+        state.autoIterations = false;
+    }
+    else if (key == "type") {
+        if (number != FRACTAL_MANDELBROT && number != FRACTAL_BURNING_SHIP) return false;
+        state.fractalType = static_cast<int>(number);
+    }
+    else if (key == "jx" || key == "jy") {
+        if (std::fabs(number) > MAX_PLANE_COORDINATE) return false;
+        (key == "jx" ? state.juliaX : state.juliaY) = number;
+    }
+    else if (key == "palette") {
+        if (number < 0 || number >= PALETTES.size()) return false;
+        state.colorScheme = static_cast<int>(number);
+    }
+    else if (key == "sf") state.stripeFrequency = static_cast<float>(number);
+    else if (key == "si") state.stripeIntensity = static_cast<float>(number);
+    else if (key == "aasamples") {
+        if (number < 1 || number > MAX_ANTI_ALIASING_SAMPLES) return false;
+        state.antiAliasingSamples = static_cast<int>(number);
+    }
+    else if (key == "width" || key == "height") {
+        if (number < 0 || number > 1 << 20) return false;
+        (key == "width" ? job.width : job.height) = static_cast<int>(number);
+    }
+    else if (key == "frames") {
+        if (number < 1) return false;
+        job.frames = static_cast<int>(number);
+    }
+    else if (key == "fps") {
+        if (number <= 0) return false;
+        job.fps = number;
+    }
+    else return false;
+    return true;
 }
 
-inline ReturnInfo calculateFractal(double cr, double ci, double jr, double ji, int maxIter, bool isJulia, int fractalType, bool stripes, float stripeFrequency, bool innerCalculation) {
-    double zr = isJulia ? cr : 0;
-    double zi = isJulia ? ci : 0;
-    double cr_actual = isJulia ? jr : cr;
-    double ci_actual = isJulia ? ji : ci;
+std::string trimSpaces(const std::string& text) {
+    size_t first = text.find_first_not_of(" \t\r");
+    if (first == std::string::npos) return "";
+    return text.substr(first, text.find_last_not_of(" \t\r") - first + 1);
+}
 
-    ReturnInfo iterationInfo;
+bool applyJobLine(BatchJob& job, const std::string& line, const std::string& where) {
+    size_t equals = line.find('=');
+    if (equals == std::string::npos ||
+        !applyJobSetting(job, trimSpaces(line.substr(0, equals)), trimSpaces(line.substr(equals + 1)))) {
+        std::cerr << where << ": bad setting \"" << line << "\"" << std::endl;
+        return false;
+    }
+    return true;
+}
 
-    if (!innerCalculation && !isJulia && fractalType == 0) {
-        double q = (cr - 0.25) * (cr - 0.25) + ci * ci;
-        if (q * (q + (cr - 0.25)) < 0.25 * ci * ci) {
-            iterationInfo.iteration = -1;
-            return iterationInfo;
-        }
+// Job files hold "key = value" lines and '#' comments. A "---" line, such as
+// the header of an outputStateDetails dump, starts the next job. Settings
+// carry over from job to job.
+bool readJobFile(const std::string& path, BatchJob& current, bool& hasSettings, std::vector<BatchJob>& jobs) {
+    std::ifstream file(path);
+    if (!file) {
+        std::cerr << "Could not open job file " << path << std::endl;
+        return false;
+    }
 
-        if ((cr + 1.0) * (cr + 1.0) + ci * ci < 0.0625) {
-            iterationInfo.iteration = -1;
-            return iterationInfo;
+    std::string line;
+    for (int lineNumber = 1; std::getline(file, line); lineNumber++) {
+        line = trimSpaces(line);
+        if (line.empty() || line[0] == '#') continue;
+        if (line.compare(0, 3, "---") == 0) {
+            if (hasSettings) jobs.push_back(current);
+            hasSettings = false;
+            continue;
         }
+        if (!applyJobLine(current, line, path + ":" + std::to_string(lineNumber))) return false;
+        hasSettings = true;
     }
+    return true;
+}
 
-    double zr2 = zr * zr;
-    double zi2 = zi * zi;
-    float stripeSum = 0;
-    int i = 0;
+// Fills in a missing width or height from the aspect ratio of the job's
+// view. Other shapes would stretch the view and are refused.
+bool getJobSize(const BatchJob& job, int& width, int& height) {
+    double aspectRatio = job.state.aspectRatio;
+    width = job.width;
+    height = job.height;
+    if (width == 0 && height == 0) width = WINDOW_WIDTH;
+    if (width == 0) width = std::max(1, static_cast<int>(std::lround(height * aspectRatio)));
+    if (height == 0) height = std::max(1, static_cast<int>(std::lround(width / aspectRatio)));
 
-    while (zr2 + zi2 < ESCAPE_RADIUS_SQUARED) {
-        zi = (fractalType == 0) ? 2 * zr * zi : 2 * fabs(zr * zi);
-        zi += ci_actual;
-        zr = zr2 - zi2 + cr_actual;
-        zr2 = zr * zr;
-        zi2 = zi * zi;
-        if (stripes) stripeSum += powf(sin(atan2(zi, zr) * stripeFrequency), 2.0);
-        i++;
-        if (i == maxIter) {
-            if (innerCalculation) {
-                iterationInfo.iteration = i;
-                iterationInfo.smoothIteration = i + 1 - log(log(zr2 + zi2) / 2) / log(2);
-                iterationInfo.stripeSum = stripeSum;
-                return iterationInfo;
-            }
-            else {
-                iterationInfo.iteration = -1;
-                return iterationInfo;
-            }
-        }
+    if (std::fabs(static_cast<double>(width) / height / aspectRatio - 1) > 0.01) {
+        std::cerr << width << "x" << height << " does not match the aspect ratio " << aspectRatio << std::endl;
+        return false;
     }
-
-    iterationInfo.iteration = i;
-    iterationInfo.smoothIteration = i + 1 - log(log(zr2 + zi2) / 2) / log(2);
-    iterationInfo.stripeSum = stripeSum;
-    return iterationInfo;
+    return true;
 }
 
-sf::Color calculateAntiAliasedColor(int x, int y, const RenderState& state, int width, int height, const std::vector<sf::Color>& palette) {
-    double pixelHeight = state.viewportHeight / height;
-    double pixelWidth = state.getViewportWidth() / width;
-    double halfHeight = state.viewportHeight / 2;
-    double halfWidth = state.getViewportWidth() / 2;
+// The view a fraction `t` of the way from `from` to `to`; everything else
+// stays as in `from`. The height moves exponentially and the center with it,
+// so the whole segment is one zoom about the single point that sits at the
+// same place on screen in both keyframes.
+RenderState interpolateView(const RenderState& from, const RenderState& to, double t) {
+    RenderState view = from;
+    double ratio = to.viewportHeight / from.viewportHeight;
+    view.viewportHeight = from.viewportHeight * std::pow(ratio, t);
+
+    // The fraction of the way the center has moved when the height is
+    // exponential: (1 - h/h0) / (1 - h1/h0), or plain t for a pure pan.
+    double progress = std::fabs(ratio - 1) < 1e-9 ? t : (1 - view.viewportHeight / from.viewportHeight) / (1 - ratio);
+    HighPrecision amount(progress);
+    int limbs = getReferenceFractionLimbs(view);
+    setViewCenter(view,
+        getCenterX(from) + multiply(getCenterX(to) - getCenterX(from), amount, limbs),
+        getCenterY(from) + multiply(getCenterY(to) - getCenterY(from), amount, limbs));
+    return view;
+}
 
+// An image rendered ANIMATION_KEY_SCALE times the frame size; it serves every
+// frame that lies inside its view and is at most that many times smaller.
+struct AnimationKey {
+    RenderState state;
+    int width = 0;
+    int height = 0;
+    int segment = -1;
+    std::vector<sf::Uint8> pixels;
 
-    std::vector<sf::Color> sampleColors;
-    sampleColors.reserve(samples * samples);
+    bool covers(const RenderState& frame, int frameSegment) const;
+};
 
-    for (int sy = 0; sy < samples; sy++) {
-        for (int sx = 0; sx < samples; sx++) {
-            double offsetX = (sx + 0.5) / samples;
-            double offsetY = (sy + 0.5) / samples;
+bool AnimationKey::covers(const RenderState& frame, int frameSegment) const {
+    if (segment != frameSegment) return false;
 
-            double cr = state.viewportX - halfWidth + (x + offsetX) * pixelWidth;
-            double ci = state.viewportY - halfHeight + (y + offsetY) * pixelHeight;
+    constexpr double SLACK = 1e-9;
+    double ratio = frame.viewportHeight / state.viewportHeight;
+    if (ratio > 1 + SLACK || ratio < 1.0 / ANIMATION_KEY_SCALE - SLACK) return false;
 
-            ReturnInfo info = calculateFractal(cr, ci, state.juliaX, state.juliaY,
-                state.maxIterations, state.showJulia, state.fractalType, state.stripes,
-                state.stripeFrequency, state.innerCalculation);
+    double offsetX = (getCenterX(frame) - getCenterX(state)).toDouble();
+    double offsetY = (getCenterY(frame) - getCenterY(state)).toDouble();
+    return std::fabs(offsetX) + frame.getViewportWidth() / 2 <= state.getViewportWidth() / 2 * (1 + SLACK) &&
+        std::fabs(offsetY) + frame.viewportHeight / 2 <= state.viewportHeight / 2 * (1 + SLACK);
+}
 
-            sf::Color color;
-            if (info.iteration == -1) {
-                color = sf::Color(0, 0, 0);
-            }
-            else {
-                float iterations;
-                if (state.stripes) {
-                    iterations = state.stripeIntensity * (info.stripeSum / info.iteration);
-                }
-                else {
-                    iterations = info.smoothIteration * state.colorDensity;
-                }
-                int index = static_cast<int>(iterations) % palette.size();
-                double fract = iterations - std::floor(iterations);
-                color = interpolateColors(palette[index], palette[(index + 1) % palette.size()], fract);
-            }
+// For each of `count` output pixels, the key pixels its footprint covers:
+// the first one and up to three area weights.
+struct ResampleTaps {
+    std::vector<int> first;
+    std::vector<std::array<float, 3>> weights;
+};
 
-            sampleColors.push_back(color);
+// Output pixel i covers key pixels [start + i * step, start + (i + 1) * step)
+// with 1 <= step <= ANIMATION_KEY_SCALE.
+ResampleTaps makeResampleTaps(int count, double start, double step) {
+    ResampleTaps taps;
+    taps.first.resize(count);
+    taps.weights.resize(count);
+    for (int i = 0; i < count; i++) {
+        double left = start + i * step;
+        double right = left + step;
+        int first = static_cast<int>(std::floor(left));
+        taps.first[i] = first;
+        for (int k = 0; k < 3; k++) {
+            double covered = std::min<double>(first + k + 1, right) - std::max<double>(first + k, left);
+            taps.weights[i][k] = static_cast<float>(std::max(0.0, covered) / step);
         }
     }
+    return taps;
+}
 
-    int totalR = 0, totalG = 0, totalB = 0;
-    for (const auto& color : sampleColors) {
-        totalR += color.r;
-        totalG += color.g;
-        totalB += color.b;
-    }
+// Box-filters the frame `view` out of `key` into packed RGB.
+void resampleFrame(RenderThreadPool& pool, const AnimationKey& key, const RenderState& view,
+    int width, int height, std::vector<uint8_t>& rgb) {
+    double keyPixelWidth = key.state.getViewportWidth() / key.width;
+    double keyPixelHeight = key.state.viewportHeight / key.height;
+    double stepX = view.getViewportWidth() / width / keyPixelWidth;
+    double stepY = view.viewportHeight / height / keyPixelHeight;
+    double offsetX = (getCenterX(view) - getCenterX(key.state)).toDouble() / keyPixelWidth;
+    double offsetY = (getCenterY(view) - getCenterY(key.state)).toDouble() / keyPixelHeight;
 
-    int sampleCount = sampleColors.size();
-    return sf::Color(
-        static_cast<sf::Uint8>(totalR / sampleCount),
-        static_cast<sf::Uint8>(totalG / sampleCount),
-        static_cast<sf::Uint8>(totalB / sampleCount)
-    );
+    ResampleTaps columns = makeResampleTaps(width, key.width / 2.0 + offsetX - width * stepX / 2, stepX);
+    ResampleTaps rows = makeResampleTaps(height, key.height / 2.0 + offsetY - height * stepY / 2, stepY);
+
+    pool.run(makeTiles(width, height, RENDER_TILE_SIZE), [&](const RenderTile& tile, int) {
+        for (int y = tile.startY; y < tile.endY; y++) {
+            for (int x = tile.startX; x < tile.endX; x++) {
+                float sum[3] = {};
+                for (int ky = 0; ky < 3; ky++) {
+                    float rowWeight = rows.weights[y][ky];
+                    if (rowWeight == 0) continue;
+                    int sourceY = std::clamp(rows.first[y] + ky, 0, key.height - 1);
+                    const sf::Uint8* source = key.pixels.data() + static_cast<size_t>(sourceY) * key.width * 4;
+                    for (int kx = 0; kx < 3; kx++) {
+                        float weight = rowWeight * columns.weights[x][kx];
+                        if (weight == 0) continue;
+                        const sf::Uint8* pixel = source + std::clamp(columns.first[x] + kx, 0, key.width - 1) * 4;
+                        for (int c = 0; c < 3; c++) sum[c] += weight * pixel[c];
+                    }
+                }
+                uint8_t* out = rgb.data() + (static_cast<size_t>(y) * width + x) * 3;
+                for (int c = 0; c < 3; c++) out[c] = static_cast<uint8_t>(std::min(255.0f, sum[c] + 0.5f));
+            }
+        }
+    });
 }
 
-void renderFractal(sf::Uint8* pixels, const RenderState& state, int width, int height, bool usePreview = false) {
-    if (usePreview) {
-        renderPreview(pixels, state, width, height, PREVIEW_DOWNSCALE);
+// Renders the path through `jobs` (each a keyframe) as a zoom video and
+// streams raw RGB frames to `encoderCommand`, or straight into `videoPath`
+// for a ".rgb" path. Frames are resampled from key images, each rendered
+// once per halving of the zoom rather than once per frame. Segments that
+// zoom on a fixed center share one reference orbit computed for their
+// deepest key. With a `cluster` the workers render the keys instead.
+int runAnimation(RenderThreadPool& pool, std::vector<BatchJob>& jobs, const std::string& videoPath,
+    std::string encoderCommand, RenderCluster* cluster) {
+    if (jobs.size() < 2) {
+        std::cerr << "A zoom video needs at least two keyframes" << std::endl;
+        return 1;
     }
-    else {
-        std::vector<std::thread> threads;
-        int linesPerThread = height / NUM_THREADS;
 
-        for (int i = 0; i < NUM_THREADS; i++) {
-            int startY = i * linesPerThread;
-            int endY = (i == NUM_THREADS - 1) ? height : (i + 1) * linesPerThread;
-            threads.emplace_back(renderFractalRegion, pixels, std::ref(state), startY, endY, width, height);
-        }
+    int width;
+    int height;
+    if (!getJobSize(jobs[0], width, height)) return 1;
+    // Video encoders want even sizes for 4:2:0 chroma.
+    width &= ~1;
+    height &= ~1;
 
-        for (auto& thread : threads) {
-            thread.join();
-        }
+    bool rawOutput = std::filesystem::path(videoPath).extension() == ".rgb";
+    if (encoderCommand.empty()) {
+        std::stringstream command;
+        command << "ffmpeg -loglevel error -y -f rawvideo -pix_fmt rgb24 -s " << width << "x" << height
+            << " -r " << jobs[0].fps << " -i - -c:v libx264 -pix_fmt yuv420p \"" << videoPath << "\"";
+        encoderCommand = command.str();
     }
-}
 
-void renderFractalRegion(sf::Uint8* pixels, const RenderState& state, int startY, int endY, int width, int height) {
-    double pixelHeight = state.viewportHeight / height;
-    double pixelWidth = state.getViewportWidth() / width;
-    double halfHeight = state.viewportHeight / 2;
-    double halfWidth = state.getViewportWidth() / 2;
-    const auto& palette = PALETTES[state.colorScheme % PALETTES.size()];
+#ifdef _WIN32
+    FILE* encoder = rawOutput ? fopen(videoPath.c_str(), "wb") : _popen(encoderCommand.c_str(), "wb");
+#else
+    FILE* encoder = rawOutput ? fopen(videoPath.c_str(), "wb") : popen(encoderCommand.c_str(), "w");
+#endif
+    if (!encoder) {
+        std::cerr << "Could not start " << (rawOutput ? videoPath : encoderCommand) << std::endl;
+        return 1;
+    }
 
-    for (int y = startY; y < endY; y++) {
-        for (int x = 0; x < width; x++) {
-            sf::Color color;
+    int totalFrames = 1;
+    for (size_t i = 1; i < jobs.size(); i++) totalFrames += jobs[i].frames;
+    std::cout << "Rendering a " << totalFrames << "-frame " << width << "x" << height << " zoom video -> "
+        << videoPath << std::endl;
 
-            if (state.antiAliasing) {
-                color = calculateAntiAliasedColor(x, y, state, width, height, palette);
+    auto start = std::chrono::high_resolution_clock::now();
+    AnimationKey key;
+    std::unique_ptr<ReferenceOrbit> segmentReference;
+    RenderState segmentReferenceState;
+    std::vector<uint8_t> rgb(static_cast<size_t>(width) * height * 3);
+    int keyCount = 0;
+    int frameIndex = 0;
+    bool failed = false;
+
+    for (int segment = 0; segment + 1 < static_cast<int>(jobs.size()) && !failed; segment++) {
+        const RenderState& from = jobs[segment].state;
+        const RenderState& to = jobs[segment + 1].state;
+        int frames = jobs[segment + 1].frames;
+        bool fixedCenter = getCenterX(from) == getCenterX(to) && getCenterY(from) == getCenterY(to);
+        bool zoomingIn = to.viewportHeight < from.viewportHeight;
+
+        segmentReference.reset();
+        if (fixedCenter) {
+            segmentReferenceState = interpolateView(from, to, 1);
+            segmentReferenceState.viewportHeight = std::min(from.viewportHeight, to.viewportHeight);
+            adjustIterations(segmentReferenceState);
+            if (usesPerturbation(segmentReferenceState)) {
+                segmentReference = std::make_unique<ReferenceOrbit>(computeReferenceOrbit(segmentReferenceState));
             }
-            else {
-                double cr = state.viewportX - halfWidth + x * pixelWidth;
-                double ci = state.viewportY - halfHeight + y * pixelHeight;
+        }
 
-                ReturnInfo info = calculateFractal(cr, ci, state.juliaX, state.juliaY,
-                    state.maxIterations, state.showJulia, state.fractalType, state.stripes, state.stripeFrequency, state.innerCalculation);
+        for (int k = (segment == 0) ? 0 : 1; k <= frames && !failed; k++) {
+            RenderState view = interpolateView(from, to, static_cast<double>(k) / frames);
 
-                if (info.iteration == -1) {
-                    color = sf::Color(0, 0, 0);
+            if (!key.covers(view, segment)) {
+                // A key from this frame on. Zooms in use it down to 1/ANIMATION_KEY_SCALE
+                // of its height, so it starts at the frame, or a little above it to leave
+                // room for the center's drift. Zooms out and pans start at the other end:
+                // the key is ANIMATION_KEY_SCALE frames tall, and the frame grows, or
+                // drifts, into it.
+                double margin = fixedCenter ? 1.0 : 1.25;
+                key.state = view;
+                // Iterations for the deepest frame the key serves.
+                key.state.viewportHeight = zoomingIn ? view.viewportHeight / ANIMATION_KEY_SCALE * margin :
+                    view.viewportHeight;
+                adjustIterations(key.state);
+                key.state.viewportHeight = zoomingIn ? view.viewportHeight * margin :
+                    view.viewportHeight * ANIMATION_KEY_SCALE;
+                key.width = width * ANIMATION_KEY_SCALE;
+                key.height = height * ANIMATION_KEY_SCALE;
+                key.segment = segment;
+                key.pixels.resize(static_cast<size_t>(key.width) * key.height * 4);
+
+                if (cluster) {
+                    sf::Uint8* keyRow = key.pixels.data();
+                    cluster->render(pool, key.state, key.width, key.height, [&](const sf::Uint8* row) {
+                        keyRow = std::copy(row, row + key.width * 4, keyRow);
+                    }, false);
                 }
                 else {
-                    float iterations;
-                    if (state.stripes) {
-                        iterations = state.stripeIntensity * (info.stripeSum / info.iteration);
-                    }
-                    else {
-                        iterations = info.smoothIteration * state.colorDensity;
+                    std::unique_ptr<ReferenceOrbit> prepared;
+                    if (segmentReference && usesPerturbation(key.state) &&
+                        key.state.maxIterations <= segmentReferenceState.maxIterations) {
+                        prepared = std::make_unique<ReferenceOrbit>(*segmentReference);
+                        prepareApproximations(*prepared, key.state);
                     }
-                    int index = static_cast<int>(iterations) % palette.size();
-                    double fract = iterations - std::floor(iterations);
-                    color = interpolateColors(palette[index], palette[(index + 1) % palette.size()], fract);
+                    BandRenderer(pool, key.state, key.width, key.height, std::move(prepared))
+                        .render(0, key.height, key.pixels.data());
                 }
+                keyCount++;
             }
 
-            int pixelIndex = (y * width + x) * 4;
-            pixels[pixelIndex] = color.r;
-            pixels[pixelIndex + 1] = color.g;
-            pixels[pixelIndex + 2] = color.b;
-            pixels[pixelIndex + 3] = 255;
+            resampleFrame(pool, key, view, width, height, rgb);
+            if (fwrite(rgb.data(), 1, rgb.size(), encoder) != rgb.size()) {
+                std::cerr << "The encoder stopped accepting frames" << std::endl;
+                failed = true;
+            }
+
+            frameIndex++;
+            if (frameIndex % 60 == 0 || frameIndex == totalFrames) {
+                std::cout << "  frame " << frameIndex << "/" << totalFrames << " (" << keyCount << " keys)" << std::endl;
+            }
         }
     }
-}
 
+#ifdef _WIN32
+    int status = rawOutput ? fclose(encoder) : _pclose(encoder);
+#else
+    int status = rawOutput ? fclose(encoder) : pclose(encoder);
+#endif
+    if (status != 0) failed = true;
 
-void renderPreview(sf::Uint8* pixels, const RenderState& state, int width, int height, int downscale) {
-    double pixelHeight = state.viewportHeight / height;
-    double pixelWidth = state.getViewportWidth() / width;
-    double halfHeight = state.viewportHeight / 2;
-    double halfWidth = state.getViewportWidth() / 2;
-    const auto& palette = PALETTES[state.colorScheme % PALETTES.size()];
+    double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+    std::stringstream summary;
+    summary << (failed ? "Video failed after " : "Video written: ") << frameIndex << " frames from " << keyCount
+        << " key renders in " << std::fixed << std::setprecision(2) << seconds << "s";
+    std::cout << summary.str() << std::endl;
+    return failed ? 1 : 0;
+}
 
-    for (int y = 0; y < height; y += downscale) {
-        double ci = state.viewportY - halfHeight + y * pixelHeight;
+// A canonical benchmark view. `scale` > 1 renders it as a hi-res export,
+// PNG encoding included.
+struct BenchmarkView {
+    std::string name;
+    RenderState state;
+    int scale = 1;
+};
 
-        for (int x = 0; x < width; x += downscale) {
-            double cr = state.viewportX - halfWidth + x * pixelWidth;
+std::vector<BenchmarkView> makeBenchmarkViews() {
+    std::vector<BenchmarkView> views;
 
-            ReturnInfo info = calculateFractal(cr, ci, state.juliaX, state.juliaY,
-                state.maxIterations, state.showJulia, state.fractalType, state.stripes, state.stripeFrequency, state.innerCalculation);
+    RenderState standard;
+    adjustIterations(standard);
+    views.push_back({ "default", standard });
 
-            sf::Color color;
-            if (info.iteration == -1) {
-                color = sf::Color(0, 0, 0);
-            }
-            else {
-                float iterations;
-                if (state.stripes)
-                {
-                    iterations = state.stripeIntensity * (info.stripeSum / info.iteration);
-                }
-                else {
-                    iterations = info.smoothIteration * state.colorDensity;
-                }
-                int index = static_cast<int>(iterations) % palette.size();
-                double fract = iterations - std::floor(iterations);
-                color = interpolateColors(palette[index], palette[(index + 1) % palette.size()], fract);
-            }
-
-            for (int by = 0; by < downscale && y + by < height; by++) {
-                for (int bx = 0; bx < downscale && x + bx < width; bx++) {
-                    int idx = ((y + by) * width + (x + bx)) * 4;
-                    pixels[idx] = color.r;
-                    pixels[idx + 1] = color.g;
-                    pixels[idx + 2] = color.b;
-                    pixels[idx + 3] = 255;
-                }
-            }
-        }
-    }
-}
+    RenderState seahorse;
+    HighPrecision centerX;
+    HighPrecision centerY;
+    parseHighPrecision("-0.743643887037158704752191506114774", centerX);
+    parseHighPrecision("0.131825904205311970493132056385139", centerY);
+    setViewCenter(seahorse, centerX, centerY);
+    seahorse.viewportHeight = 1e-14;
+    adjustIterations(seahorse);
+    views.push_back({ "seahorse_deep", seahorse });
 
+    RenderState interior;
+    interior.viewportX = -0.2;
+    interior.viewportHeight = 0.6;
+    interior.maxIterations = 2000;
+    interior.autoIterations = false;
+    views.push_back({ "interior", interior });
 
-void saveScreenshot(const sf::Texture& texture, const RenderState& state) {
-    sf::Image screenshot = texture.copyToImage();
+    RenderState ship;
+    ship.fractalType = FRACTAL_BURNING_SHIP;
+    ship.viewportX = -1.762;
+    ship.viewportY = -0.028;
+    ship.viewportHeight = 0.08;
+    adjustIterations(ship);
+    views.push_back({ "burning_ship", ship });
 
-    time_t now = time(0);
-    tm timeinfo;
+    RenderState julia;
+    julia.showJulia = true;
+    julia.viewportX = 0;
+    adjustIterations(julia);
+    views.push_back({ "julia", julia });
 
-#ifdef _WIN32
-    localtime_s(&timeinfo, &now);
-#else
-    tm* temp = localtime(&now);
-    if (temp) timeinfo = *temp;
-#endif
+    RenderState stripes = standard;
+    stripes.stripes = true;
+    views.push_back({ "stripes", stripes });
 
-    std::stringstream filename;
-    filename << "fractal_" << (state.showJulia ? "julia_" : "mandelbrot_")
-        << std::fixed << std::setprecision(6) << state.viewportX << "_" << state.viewportY
-        << "_zoom_" << std::setprecision(2) << (3.0 / state.viewportX)
-        << now << ".png";
+    RenderState antiAliased = standard;
+    antiAliased.antiAliasing = true;
+    views.push_back({ "anti_aliasing", antiAliased });
 
-    screenshot.saveToFile(filename.str());
-    std::cout << "Screenshot saved: " << filename.str() << std::endl;
+    views.push_back({ "hires_export", standard, 4 });
+    return views;
 }
 
-void outputStateDetails(const RenderState& state) {
+// Finds `"key": value` in one result line of a benchmark JSON file.
+std::string findJsonValue(const std::string& line, const std::string& key) {
+    size_t position = line.find("\"" + key + "\":");
+    if (position == std::string::npos) return "";
+    position += key.size() + 3;
+    while (position < line.size() && (line[position] == ' ' || line[position] == '"')) position++;
+    size_t end = line.find_first_of(",}\"", position);
+    return line.substr(position, end - position);
+}
 
-    std::cout << "--- State Details ---" << '\n';
-    std::cout << "x = " << state.viewportX << '\n';
-    std::cout << "y = " << state.viewportY << '\n';
-    std::cout << "zoom = " << state.viewportHeight << '\n';
-    std::cout << "cd = " << state.colorDensity << '\n';
+// Steps an interactive session on the default view through the jobs the
+// event loop starts most: a drag, a recolor and back, and a wheel zoom in
+// and out, writing the overlay's view description on every poll as the
+// event loop does. After one warm-up round, runs `repeats` more and returns
+// the heap allocations they made, which should be none, or -1 in builds
+// that don't count them; `times` gets their milliseconds per job. The
+// session has no window, so the texture uploads, the text layout SFML does
+// and the GPU backend are not part of it.
+long long runInteractiveSession(RenderThreadPool& pool, int repeats, std::vector<double>& times) {
+    FrameBuffer frame(WINDOW_WIDTH, WINDOW_HEIGHT);
+    AsyncRenderer renderer(pool, frame);
+    RenderState state;
+    adjustIterations(state);
+    constexpr int JOBS_PER_ROUND = 5;
+    times.reserve(static_cast<size_t>(repeats) * JOBS_PER_ROUND);
+    bool measuring = false;
+    std::string info;
+
+    auto runJob = [&](RenderMode mode) {
+        auto start = std::chrono::high_resolution_clock::now();
+        renderer.start(state, mode);
+        while (!renderer.advance()) {
+            writeInfoString(info, state, WINDOW_HEIGHT);
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        if (measuring) times.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+    };
 
-    std::cout << "maxit = " << state.maxIterations << '\n';
+    runJob(RenderMode::Full);
+    long long allocations = 0;
+    for (int round = 0; round <= repeats; round++) {
+        measuring = round > 0;
+        long long before = getHeapAllocations();
+        moveView(state, 7 * state.getViewportWidth() / WINDOW_WIDTH, -3 * state.viewportHeight / WINDOW_HEIGHT);
+        runJob(RenderMode::Full);
+        state.colorDensity *= 1.2f;
+        runJob(RenderMode::Recolor);
+        state.colorDensity /= 1.2f;
+        runJob(RenderMode::Recolor);
+        zoomAtPixel(state, WINDOW_WIDTH, WINDOW_HEIGHT, WINDOW_WIDTH / 3, WINDOW_HEIGHT / 3, 0.5);
+        runJob(RenderMode::Progressive);
+        zoomAtPixel(state, WINDOW_WIDTH, WINDOW_HEIGHT, WINDOW_WIDTH / 3, WINDOW_HEIGHT / 3, 2.0);
+        runJob(RenderMode::Progressive);
+        if (measuring) allocations += getHeapAllocations() - before;
+    }
+    return getHeapAllocations() < 0 ? -1 : allocations;
 }
 
+// Runs every canonical view `repeats` times at each thread count and
+// reports ms/frame, Mpixel/s and Giter/s as JSON, one result per line,
+// followed by an interactive session of render jobs, which in builds with
+// FRACTAL_COUNT_ALLOCATIONS must not touch the heap once warmed up.
+// With a `baselinePath` from an earlier run, views that got more than
+// 10% slower count as regressions and fail the run.
+int runBenchmark(const std::vector<int>& threadCounts, int repeats, const std::string& jsonPath,
+    const std::string& baselinePath) {
+    std::vector<BenchmarkView> views = makeBenchmarkViews();
+    std::vector<std::string> results;
+    int allocatingSessions = 0;
+    std::string exportPath = (std::filesystem::temp_directory_path() / "fractal_benchmark.png").string();
 
-void saveHighResScreenshot(const RenderState& state, int width, int height, int scale) {
-    int hiResWidth = width * scale;
-    int hiResHeight = height * scale;
-    sf::Uint8* hiResPixels = new sf::Uint8[hiResWidth * hiResHeight * 4];
+    for (int threads : threadCounts) {
+        RenderThreadPool pool(threads);
+        for (const BenchmarkView& view : views) {
+            int width = WINDOW_WIDTH * view.scale;
+            int height = WINDOW_HEIGHT * view.scale;
+            std::vector<sf::Uint8> pixels(view.scale == 1 ? static_cast<size_t>(width) * height * 4 : 0);
+            std::vector<double> times;
+            KernelCounters counters;
 
-    std::cout << "Rendering high-resolution screenshot (" << hiResWidth << "x" << hiResHeight << ")..." << std::endl;
+            // One warm-up run, then the measured ones.
+            for (int run = 0; run <= repeats; run++) {
+                auto start = std::chrono::high_resolution_clock::now();
+                if (view.scale == 1) {
+                    BandRenderer renderer(pool, view.state, width, height);
+                    renderer.render(0, height, pixels.data());
+                    counters = renderer.getCounters();
+                }
+                else {
+                    PngWriter png;
+                    png.open(exportPath, width, height);
+                    counters = renderBands(pool, view.state, width, height,
+                        [&](const sf::Uint8* row) { png.writeRow(row, 4); }, false);
+                    png.close();
+                }
+                auto end = std::chrono::high_resolution_clock::now();
+                if (run > 0) times.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+            }
 
-    RenderState hiResState = state;
-    hiResState.viewportX = state.viewportX;
+            std::sort(times.begin(), times.end());
+            double median = times[times.size() / 2];
+            double pixelCount = static_cast<double>(width) * height;
 
-    std::vector<std::thread> threads;
-    int linesPerThread = hiResHeight / NUM_THREADS;
+            std::stringstream result;
+            result << std::fixed << std::setprecision(3)
+                << "{\"view\": \"" << view.name << "\", \"threads\": " << threads
+                << ", \"width\": " << width << ", \"height\": " << height
+                << ", \"max_iterations\": " << view.state.maxIterations
+                << ", \"precision\": \"" << getPrecisionName(selectPrecision(view.state, height)) << "\""
+                << ", \"ms_median\": " << median << ", \"ms_min\": " << times.front()
+                << ", \"mpixel_per_s\": " << pixelCount / median / 1e3
+                << ", \"giter_per_s\": " << counters.iterations / median / 1e6 << "}";
+            results.push_back(result.str());
+            std::clog << view.name << " (" << threads << " threads): " << std::fixed << std::setprecision(1)
+                << median << " ms" << std::endl;
+        }
 
-    for (int i = 0; i < NUM_THREADS; i++) {
-        int startY = i * linesPerThread;
-        int endY = (i == NUM_THREADS - 1) ? hiResHeight : (i + 1) * linesPerThread;
-        threads.emplace_back(renderFractalRegion, hiResPixels, std::ref(hiResState), startY, endY, hiResWidth, hiResHeight);
+        std::vector<double> times;
+        long long allocations = runInteractiveSession(pool, repeats, times);
+        std::sort(times.begin(), times.end());
+        double median = times[times.size() / 2];
+        std::stringstream result;
+        result << std::fixed << std::setprecision(3)
+            << "{\"view\": \"interactive\", \"threads\": " << threads
+            << ", \"width\": " << WINDOW_WIDTH << ", \"height\": " << WINDOW_HEIGHT
+            << ", \"jobs\": " << times.size() << ", \"ms_median\": " << median << ", \"ms_min\": " << times.front();
+        if (allocations >= 0) result << ", \"heap_allocations\": " << allocations;
+        result << "}";
+        results.push_back(result.str());
+        std::clog << "interactive (" << threads << " threads): " << std::fixed << std::setprecision(1)
+            << median << " ms per job";
+        if (allocations >= 0) std::clog << ", " << allocations << " heap allocations";
+        std::clog << (allocations > 0 ? "  ALLOCATING" : "") << std::endl;
+        allocatingSessions += allocations > 0;
     }
+    std::filesystem::remove(exportPath);
+
+    std::stringstream json;
+    json << "{\"simd\": \"" << getSimdLevelName(SIMD_LEVEL) << "\", \"hardware_threads\": "
+        << std::thread::hardware_concurrency() << ", \"repeats\": " << repeats << ", \"results\": [\n";
+    for (size_t i = 0; i < results.size(); i++) json << "  " << results[i] << (i + 1 < results.size() ? ",\n" : "\n");
+    json << "]}\n";
 
-    for (auto& thread : threads) {
-        thread.join();
+    if (jsonPath.empty()) {
+        std::cout << json.str();
+    }
+    else {
+        std::ofstream file(jsonPath);
+        file << json.str();
+        if (!file) {
+            std::cerr << "Could not write " << jsonPath << std::endl;
+            return 1;
+        }
     }
 
-    sf::Image screenshot;
-    screenshot.create(hiResWidth, hiResHeight, hiResPixels);
+    if (baselinePath.empty()) return allocatingSessions == 0 ? 0 : 1;
+    std::ifstream baseline(baselinePath);
+    if (!baseline) {
+        std::cerr << "Could not open baseline " << baselinePath << std::endl;
+        return 1;
+    }
 
-    time_t now = time(0);
-    tm timeinfo;
+    int regressions = 0;
+    std::string line;
+    while (std::getline(baseline, line)) {
+        std::string name = findJsonValue(line, "view");
+        std::string threads = findJsonValue(line, "threads");
+        if (name.empty()) continue;
+        for (const std::string& result : results) {
+            if (findJsonValue(result, "view") != name || findJsonValue(result, "threads") != threads) continue;
+            double before = std::atof(findJsonValue(line, "ms_median").c_str());
+            double after = std::atof(findJsonValue(result, "ms_median").c_str());
+            double change = before > 0 ? (after / before - 1) * 100 : 0;
+            bool regressed = change > 10;
+            regressions += regressed;
+            std::clog << name << " (" << threads << " threads): " << std::fixed << std::setprecision(1) << before
+                << " -> " << after << " ms (" << std::showpos << change << std::noshowpos << "%)"
+                << (regressed ? "  REGRESSION" : "") << std::endl;
+        }
+    }
+    return regressions == 0 && allocatingSessions == 0 ? 0 : 1;
+}
 
-#ifdef _WIN32
-    localtime_s(&timeinfo, &now);
-#else
-    tm* temp = localtime(&now);
-    if (temp) timeinfo = *temp;
-#endif
+void printBatchUsage() {
+    std::cout << "Usage: fractalExplorer [job files] [key=value ...] [--] ...\n"
+        << "Renders without a window. Keys are those of the state details dump plus\n"
+        << "width, height (derived from the window aspect if 0) and output (.png,\n"
+        << "or .dzi for a DeepZoom pyramid). \"--\" or a \"---\" line in a job file\n"
+        << "ends a job; settings carry over to the next one.\n"
+        << "--video <file> turns the jobs into keyframes of one zoom video instead;\n"
+        << "\"frames\" is the length of the segment ending at a keyframe and \"fps\" is\n"
+        << "taken from the first. Frames go to ffmpeg as raw RGB, or to any\n"
+        << "--encoder <command> reading them on stdin; a .rgb file keeps them raw.\n"
+        << "--benchmark times the canonical views instead, with --threads <n,n,...>,\n"
+        << "--repeats <n>, --json <file> (else stdout) and --baseline <earlier json>.\n"
+        << "It also times a session of interactive render jobs; built with\n"
+        << "FRACTAL_COUNT_ALLOCATIONS, the run fails if those jobs allocate on the\n"
+        << "heap once warmed up.\n"
+        << "--worker [port] serves band jobs to coordinators (default port "
+        << DEFAULT_WORKER_PORT << "), and\n"
+        << "--workers <host[:port],...> renders the jobs' bands on those workers." << std::endl;
+}
 
-    std::stringstream filename;
-    filename << "fractal_" << (state.showJulia ? "julia_" : "mandelbrot_")
-        << std::fixed << std::setprecision(6) << state.viewportX << "_" << state.viewportY
-        << "_zoom_" << std::setprecision(2) << (3.0 / state.viewportX)
-        << "_hires_" << hiResWidth << "x" << hiResHeight << "_"
-        << now << ".png";
+// Headless mode: renders the jobs given on the command line through the
+// banded exporters and never creates a window or GL context.
+int runBatch(int argc, char* argv[]) {
+    std::vector<BatchJob> jobs;
+    BatchJob current;
+    bool hasSettings = false;
+    std::string videoPath;
+    std::string encoderCommand;
+    bool benchmark = false;
+    std::string jsonPath;
+    std::string baselinePath;
+    int repeats = 3;
+    std::vector<int> threadCounts = { NUM_THREADS };
+    int workerPort = 0;
+    std::vector<std::string> workerAddresses;
 
-    screenshot.saveToFile(filename.str());
-    std::cout << "High-resolution screenshot saved: " << filename.str() << std::endl;
+    for (int i = 1; i < argc; i++) {
+        std::string argument = argv[i];
+        if (argument == "-h" || argument == "--help") {
+            printBatchUsage();
+            return 0;
+        }
+        if (argument == "--") {
+            if (hasSettings) jobs.push_back(current);
+            hasSettings = false;
+        }
+        else if ((argument == "--video" || argument == "--encoder") && i + 1 < argc) {
+            (argument == "--video" ? videoPath : encoderCommand) = argv[++i];
+        }
+        else if (argument == "--benchmark") {
+            benchmark = true;
+        }
+        else if (argument == "--worker") {
+            workerPort = DEFAULT_WORKER_PORT;
+            if (i + 1 < argc && std::atoi(argv[i + 1]) > 0) workerPort = std::atoi(argv[++i]);
+        }
+        else if (argument == "--workers" && i + 1 < argc) {
+            std::stringstream list(argv[++i]);
+            std::string address;
+            while (std::getline(list, address, ',')) {
+                if (!address.empty()) workerAddresses.push_back(address);
+            }
+        }
+        else if ((argument == "--json" || argument == "--baseline") && i + 1 < argc) {
+            (argument == "--json" ? jsonPath : baselinePath) = argv[++i];
+        }
+        else if (argument == "--repeats" && i + 1 < argc) {
+            repeats = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (argument == "--threads" && i + 1 < argc) {
+            std::stringstream list(argv[++i]);
+            std::string count;
+            threadCounts.clear();
+            while (std::getline(list, count, ',')) {
+                if (std::atoi(count.c_str()) > 0) threadCounts.push_back(std::atoi(count.c_str()));
+            }
+        }
+        else if (argument.find('=') != std::string::npos) {
+            if (!applyJobLine(current, argument, "argument " + std::to_string(i))) return 1;
+            hasSettings = true;
+        }
+        else if (!readJobFile(argument, current, hasSettings, jobs)) {
+            return 1;
+        }
+    }
+    if (hasSettings) jobs.push_back(current);
 
-    delete[] hiResPixels;
-}
+    if (workerPort > 0) {
+        if (workerPort > 65535) {
+            std::cerr << "Invalid worker port " << workerPort << std::endl;
+            return 1;
+        }
+        return runWorker(static_cast<unsigned short>(workerPort));
+    }
+    if (benchmark) {
+        if (threadCounts.empty()) threadCounts.push_back(NUM_THREADS);
+        return runBenchmark(threadCounts, repeats, jsonPath, baselinePath);
+    }
 
-std::string getInfoString(const RenderState& state, double mouseX, double mouseY) {
-    std::stringstream ss;
-    ss << "Mode: " << (state.showJulia ? "Julia" : "Mandelbrot") << "\n";
-    ss << "Position: (" << std::fixed << std::setprecision(10) << state.viewportX
-        << ", " << state.viewportY << ")\n";
-    ss << "Zoom: " << std::setprecision(2) << (3.0 / state.viewportHeight) << "x\n";
-    ss << "Iterations: " << state.maxIterations << (state.autoIterations ? " (auto)" : "") << "\n";
+    RenderThreadPool pool(NUM_THREADS);
+    RenderCluster cluster;
+    bool distributed = !workerAddresses.empty();
+    if (distributed && !cluster.connect(workerAddresses)) return 1;
+    auto renderJob = [&](const RenderState& state, int width, int height, auto consumeRow) {
+        if (distributed) cluster.render(pool, state, width, height, consumeRow);
+        else renderBands(pool, state, width, height, consumeRow);
+    };
 
-    if (state.showJulia) {
-        ss << "Julia seed: (" << std::setprecision(6) << state.juliaX << ", " << state.juliaY << ")\n";
+    if (!videoPath.empty()) return runAnimation(pool, jobs, videoPath, encoderCommand, distributed ? &cluster : nullptr);
+    std::cout << "Rendering " << jobs.size() << " job(s) with " << NUM_THREADS << " threads ("
+        << getSimdLevelName(SIMD_LEVEL) << " kernel)" << std::endl;
+
+    auto batchStart = std::chrono::high_resolution_clock::now();
+    long long totalPixels = 0;
+    int failures = 0;
+
+    for (size_t index = 0; index < jobs.size(); index++) {
+        BatchJob& job = jobs[index];
+        adjustIterations(job.state);
+
+        int width;
+        int height;
+        if (!getJobSize(job, width, height)) {
+            failures++;
+            continue;
+        }
+
+        std::string output = job.output;
+        if (output.empty()) output = makeExportName(job.state, "batch", width, height) + "_" + std::to_string(index + 1) + ".png";
+        std::cout << "Job " << index + 1 << "/" << jobs.size() << ": " << width << "x" << height
+            << " -> " << output << std::endl;
+
+        auto jobStart = std::chrono::high_resolution_clock::now();
+        bool saved = false;
+        std::filesystem::path outputPath(output);
+        if (outputPath.extension() == ".dzi") {
+            DeepZoomWriter pyramid(outputPath.replace_extension().string() + "_files", width, height);
+            renderJob(job.state, width, height, [&](const sf::Uint8* row) { pyramid.addRow(row, 4); });
+            std::ofstream descriptor(output);
+            descriptor << DeepZoomWriter::describe(width, height);
+            descriptor.close();
+            saved = pyramid.finish() && descriptor;
+        }
+        else {
+            PngWriter png;
+            if (png.open(output, width, height)) {
+                renderJob(job.state, width, height, [&](const sf::Uint8* row) { png.writeRow(row, 4); });
+                saved = png.close();
+            }
+        }
+        auto jobEnd = std::chrono::high_resolution_clock::now();
+
+        if (!saved) {
+            std::cerr << "Job " << index + 1 << ": failed writing " << output << std::endl;
+            failures++;
+            continue;
+        }
+        totalPixels += static_cast<long long>(width) * height;
+        std::cout << "  done in " << std::chrono::duration_cast<std::chrono::milliseconds>(jobEnd - jobStart).count()
+            << "ms" << std::endl;
     }
 
-    return ss.str();
+    double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - batchStart).count();
+    std::stringstream summary;
+    summary << jobs.size() - failures << " of " << jobs.size() << " job(s) written in " << std::fixed
+        << std::setprecision(2) << seconds << "s (" << (seconds > 0 ? totalPixels / seconds / 1e6 : 0)
+        << " Mpixel/s)";
+    std::cout << summary.str() << std::endl;
+    return failures == 0 ? 0 : 1;
 }
 
-void adjustIterations(RenderState& state) {
-    if (state.autoIterations) {
-        double zoomFactor = 3.0 / state.viewportHeight;
-        state.maxIterations = std::min(10000, static_cast<int>(100 * log10(1 + zoomFactor)));
-        state.maxIterations = std::max(100, state.maxIterations);
+// FRACTAL_TILE_CACHE=off runs without the cache, for timing fresh renders.
+bool openTileCache(TileCache& cache) {
+    std::string path = DEFAULT_TILE_CACHE_PATH;
+    if (const char* requested = std::getenv("FRACTAL_TILE_CACHE")) {
+        if (std::string(requested) == "off") return false;
+        path = requested;
     }
+    long long megabytes = DEFAULT_TILE_CACHE_MEGABYTES;
+    if (const char* requested = std::getenv("FRACTAL_TILE_CACHE_MB")) {
+        if (std::atoi(requested) > 0) megabytes = std::atoi(requested);
+    }
+    if (cache.open(path, megabytes << 20)) return true;
+    std::cerr << "Could not map the tile cache " << path << ", rendering without it" << std::endl;
+    return false;
 }
 
-int main() {
-    std::cout << "Starting Fractal Explorer with " << NUM_THREADS << " threads" << std::endl;
+int main(int argc, char* argv[]) {
+    if (argc > 1) return runBatch(argc, argv);
+
+    std::cout << "Starting Fractal Explorer with " << NUM_THREADS << " threads ("
+        << getSimdLevelName(SIMD_LEVEL) << " kernel)" << std::endl;
+    RenderThreadPool renderPool(NUM_THREADS);
 
     sf::RenderWindow window(sf::VideoMode(WINDOW_WIDTH, WINDOW_HEIGHT), WINDOW_TITLE);
-    window.setFramerateLimit(60);
+    window.setFramerateLimit(TARGET_FPS);
+    // The frame, the textures and the view follow the window's size.
+    int windowWidth = WINDOW_WIDTH;
+    int windowHeight = WINDOW_HEIGHT;
 
     sf::Texture texture;
-    if (!texture.create(WINDOW_WIDTH, WINDOW_HEIGHT)) {
+    if (!texture.create(windowWidth, windowHeight)) {
         std::cerr << "Failed to create texture" << std::endl;
         return 1;
     }
 
     sf::Sprite sprite(texture);
-    sf::Uint8* pixels = new sf::Uint8[WINDOW_WIDTH * WINDOW_HEIGHT * 4];
+    FrameBuffer frame(windowWidth, windowHeight);
+
+    // Shallow views go to the shader backend while it is enabled; the sprite
+    // shown is the one of the backend that drew the current view.
+    GpuRenderer gpuRenderer;
+    bool gpuEnabled = gpuRenderer.create(windowWidth, windowHeight);
+    sf::Sprite gpuSprite(gpuRenderer.getTexture());
+    std::cout << "GPU shader backend: " << (gpuEnabled ? "available" : "unavailable") << std::endl;
+
+    // While the Julia seed is animated, its frames are drawn from a texture
+    // of their own, so the CPU frame's texture keeps what the renderer last
+    // uploaded to it.
+    SeedAnimator animator(renderPool);
+    SeedAnimation seedAnimation = SeedAnimation::Off;
+    auto seedAnimationStart = std::chrono::steady_clock::now();
+    sf::Texture animationTexture;
+    animationTexture.create(windowWidth, windowHeight);
+    animationTexture.setSmooth(true);
+    sf::Sprite animationSprite(animationTexture);
+    bool showingAnimation = false;
 
     sf::Font font;
     bool hasFontLoaded = font.loadFromFile("arial.ttf");
@@ -440,6 +6451,10 @@ int main() {
 
     sf::Text infoText;
     sf::Text performanceText;
+    // Per-tile cost heatmap and the stats panel above performanceText.
+    sf::Text statsText;
+    TileHeatmap heatmap;
+    bool showRenderStats = false;
 
     if (hasFontLoaded) {
         infoText.setFont(font);
@@ -454,75 +6469,117 @@ int main() {
         performanceText.setFillColor(sf::Color::Yellow);
         performanceText.setOutlineColor(sf::Color::Black);
         performanceText.setOutlineThickness(1);
-        performanceText.setPosition(10, WINDOW_HEIGHT - 30);
+        performanceText.setPosition(10, windowHeight - 30);
+
+        statsText.setFont(font);
+        statsText.setCharacterSize(12);
+        statsText.setFillColor(sf::Color::White);
+        statsText.setOutlineColor(sf::Color::Black);
+        statsText.setOutlineThickness(1);
     }
 
     RenderState state;
     adjustIterations(state);
 
-    auto startTime = std::chrono::high_resolution_clock::now();
-    renderFractal(pixels, state, WINDOW_WIDTH, WINDOW_HEIGHT);
-    auto endTime = std::chrono::high_resolution_clock::now();
-    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(endTime - startTime).count();
+    TileCache tileCache;
+    AsyncRenderer renderer(renderPool, frame, openTileCache(tileCache) ? &tileCache : nullptr);
+    CpuRenderBackend cpuBackend(renderer, texture);
+    RenderBackend* backend = &cpuBackend;
+    backend->start(state, RenderMode::Full);
+    while (!backend->present()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    auto duration = renderer.getRenderTime();
 
     std::cout << "Initial render: " << duration << "ms" << std::endl;
-    texture.update(pixels);
+    heatmap.update(renderer, windowWidth, windowHeight);
 
     sf::Vector2i lastMousePos;
     bool isDragging = false;
-    std::string renderTimeStr = "Render time: " + std::to_string(duration) + "ms";
+    std::string renderTimeStr;
+    appendFormatted(renderTimeStr, "Render time: %lldms", duration);
+    std::string busyTimeStr;
+    std::vector<double> busyTimes;
+    writeBusyTimeString(busyTimeStr, renderPool, busyTimes);
+    std::string counterStr;
+    writeCounterString(counterStr, renderer.getCounters());
     sf::Vector2i currentMousePos;
     double mouseComplexX = 0, mouseComplexY = 0;
 
-    bool viewChanged = false;
-    sf::Clock scrollTimer;
-    bool pendingHighQualityRender = false;
+    // The overlay shapes are built once. Its strings are written into
+    // buffers that keep their storage and only go to the texts when they
+    // differ from the ones shown; the stats panel is only rebuilt after jobs.
+    sf::RectangleShape textBg(sf::Vector2f(350, 180));
+    textBg.setFillColor(sf::Color(0, 0, 0, 180));
+    textBg.setPosition(5, 5);
+    sf::RectangleShape statsBg;
+    statsBg.setFillColor(sf::Color(0, 0, 0, 180));
+    std::string infoString;
+    std::string shownInfoString;
+    std::string performanceString;
+    std::string shownPerformanceString;
+    bool statsChanged = true;
+    bool statsShown = false;
 
     while (window.isOpen()) {
         sf::Event event;
         bool needsRedraw = false;
-        bool usePreview = false;
+        bool needsRecolor = false;
+        // Drags only uncover thin strips, which a single full pass covers in
+        // about the time of a coarse one.
+        bool onlyDragged = true;
 
         while (window.pollEvent(event)) {
             if (event.type == sf::Event::Closed)
                 window.close();
 
+            // Minimized windows report a zero size and keep their frame.
+            if (event.type == sf::Event::Resized && event.size.width > 0 && event.size.height > 0 &&
+                (static_cast<int>(event.size.width) != windowWidth ||
+                static_cast<int>(event.size.height) != windowHeight)) {
+                windowWidth = static_cast<int>(event.size.width);
+                windowHeight = static_cast<int>(event.size.height);
+                window.setView(sf::View(sf::FloatRect(0, 0, windowWidth, windowHeight)));
+
+                // The view keeps its height in the plane and widens or
+                // narrows with the window.
+                state.aspectRatio = static_cast<double>(windowWidth) / windowHeight;
+                renderer.resize(windowWidth, windowHeight);
+                texture.create(windowWidth, windowHeight);
+                sprite.setTexture(texture, true);
+                gpuRenderer.create(windowWidth, windowHeight);
+                gpuSprite.setTexture(gpuRenderer.getTexture(), true);
+                animationTexture.create(windowWidth, windowHeight);
+                animationSprite.setTexture(animationTexture, true);
+                performanceText.setPosition(10, windowHeight - 30);
+                statsChanged = true;
+                needsRedraw = true;
+                onlyDragged = false;
+            }
+
             if (event.type == sf::Event::MouseWheelScrolled) {
                 sf::Vector2i mousePos = sf::Mouse::getPosition(window);
 
-                if (mousePos.x >= 0 && mousePos.x < WINDOW_WIDTH &&
-                    mousePos.y >= 0 && mousePos.y < WINDOW_HEIGHT) {
-
-                    double halfWidth = state.getViewportWidth() / 2;
-                    double halfHeight = state.viewportHeight / 2;
-                    double mouseX = state.viewportX - halfWidth + mousePos.x * state.getViewportWidth() / WINDOW_WIDTH;
-                    double mouseY = state.viewportY - halfHeight + mousePos.y * state.viewportHeight / WINDOW_HEIGHT;
+                if (mousePos.x >= 0 && mousePos.x < windowWidth &&
+                    mousePos.y >= 0 && mousePos.y < windowHeight) {
 
                     double zoomFactor = (event.mouseWheelScroll.delta > 0) ? 0.5 : 2.0;
-
-                    state.viewportX = mouseX + (state.viewportX - mouseX) * zoomFactor;
-                    state.viewportY = mouseY + (state.viewportY - mouseY) * zoomFactor;
-                    state.viewportHeight *= zoomFactor;
+                    zoomAtPixel(state, windowWidth, windowHeight, mousePos.x, mousePos.y, zoomFactor);
 
                     adjustIterations(state);
 
                     needsRedraw = true;
-                    usePreview = true;
-                    viewChanged = true;
-                    scrollTimer.restart();
+                    onlyDragged = false;
                 }
             }
 
             if (event.type == sf::Event::MouseButtonPressed && event.mouseButton.button == sf::Mouse::Left) {
                 isDragging = true;
-                usePreview = true;
                 lastMousePos = sf::Mouse::getPosition(window);
             }
 
             if (event.type == sf::Event::MouseButtonReleased && event.mouseButton.button == sf::Mouse::Left) {
                 isDragging = false;
-                pendingHighQualityRender = true;
-                scrollTimer.restart();
             }
 
             if (event.type == sf::Event::MouseMoved) {
@@ -531,37 +6588,38 @@ int main() {
                 double halfWidth = state.getViewportWidth() / 2;
                 double halfHeight = state.viewportHeight / 2;
                 mouseComplexX = state.viewportX - halfWidth +
-                    currentMousePos.x * state.getViewportWidth() / WINDOW_WIDTH;
+                    currentMousePos.x * state.getViewportWidth() / windowWidth;
                 mouseComplexY = state.viewportY - halfHeight +
-                    currentMousePos.y * state.viewportHeight / WINDOW_HEIGHT;
+                    currentMousePos.y * state.viewportHeight / windowHeight;
 
                 if (isDragging) {
                     sf::Vector2i delta = lastMousePos - currentMousePos;
 
-                    double deltaX = delta.x * state.getViewportWidth() / WINDOW_WIDTH;
-                    double deltaY = delta.y * state.viewportHeight / WINDOW_HEIGHT;
+                    double deltaX = delta.x * state.getViewportWidth() / windowWidth;
+                    double deltaY = delta.y * state.viewportHeight / windowHeight;
 
-                    state.viewportX += deltaX;
-                    state.viewportY += deltaY;
+                    moveView(state, deltaX, deltaY);
 
+                    // Drags move by whole pixels, so the renderer shifts the frame and
+                    // only iterates the uncovered strips at full resolution.
                     lastMousePos = currentMousePos;
                     needsRedraw = true;
-                    usePreview = true;
-                    viewChanged = true;
-                    scrollTimer.restart();
                 }
             }
 
             if (event.type == sf::Event::KeyPressed) {
+                onlyDragged = false;
                 switch (event.key.code) {
+                case sf::Keyboard::R:
                     state.viewportX = -0.5;
                     state.viewportY = 0.0;
+                    state.viewportXLow = HighPrecision();
+                    state.viewportYLow = HighPrecision();
                     state.viewportHeight = 3.0;
                     adjustIterations(state);
                     needsRedraw = true;
-                    viewChanged = false;
-                    pendingHighQualityRender = true;
                     break;
+                case sf::Keyboard::J:
                     state.showJulia = !state.showJulia;
                     if (!state.showJulia) {
                         state.juliaX = mouseComplexX;
@@ -569,111 +6627,255 @@ int main() {
                     }
                     needsRedraw = true;
                     break;
+                case sf::Keyboard::C:
                     state.colorScheme = (state.colorScheme + 1) % PALETTES.size();
-                    needsRedraw = true;
+                    needsRecolor = true;
                     break;
+                case sf::Keyboard::S:
+                    // Shift+S exports a hi-res PNG, Ctrl+S a DeepZoom pyramid.
+                    // Both take the pool: a seed animation frame in flight is
+                    // dropped, or it would finish with the export's busy times.
                     if (sf::Keyboard::isKeyPressed(sf::Keyboard::LShift) ||
                         sf::Keyboard::isKeyPressed(sf::Keyboard::RShift)) {
-                        saveHighResScreenshot(state, WINDOW_WIDTH, WINDOW_HEIGHT, SCREENSHOT_SCALE);
+                        bool wasRendering = renderer.isBusy();
+                        renderer.cancel();
+                        animator.cancel();
+                        saveHighResScreenshot(renderPool, state, windowWidth, windowHeight, SCREENSHOT_SCALE);
+                        if (wasRendering) needsRedraw = true;
+                    }
+                    else if (sf::Keyboard::isKeyPressed(sf::Keyboard::LControl) ||
+                        sf::Keyboard::isKeyPressed(sf::Keyboard::RControl)) {
+                        bool wasRendering = renderer.isBusy();
+                        renderer.cancel();
+                        animator.cancel();
+                        saveDeepZoomPyramid(renderPool, state, windowWidth, windowHeight, PYRAMID_SCALE);
+                        if (wasRendering) needsRedraw = true;
                     }
                     else {
-                        saveScreenshot(texture, state);
+                        saveScreenshot(backend->getTexture(), state);
                     }
                     break;
+                case sf::Keyboard::Up:
                     state.maxIterations = static_cast<int>(state.maxIterations * 1.5);
                     state.autoIterations = false;
                     needsRedraw = true;
                     break;
+                case sf::Keyboard::Down:
                     state.maxIterations = std::max(50, static_cast<int>(state.maxIterations / 1.5));
                     state.autoIterations = false;
                     needsRedraw = true;
                     break;
+                case sf::Keyboard::M:
                     state.autoIterations = !state.autoIterations;
                     if (state.autoIterations) {
                         adjustIterations(state);
                         needsRedraw = true;
                     }
                     break;
+                case sf::Keyboard::Space:
                     needsRedraw = true;
                     break;
+                case sf::Keyboard::T:
                     state.stripes = !state.stripes;
                     needsRedraw = true;
                     break;
+                case sf::Keyboard::A:
                     state.antiAliasing = !state.antiAliasing;
                     needsRedraw = true;
-                    pendingHighQualityRender = true;
                     break;
+                case sf::Keyboard::I:
                     state.innerCalculation = !state.innerCalculation;
                     needsRedraw = true;
                     break;
-                    state.colorDensity *= 1.2f;
+                case sf::Keyboard::F3:
+                    showRenderStats = !showRenderStats;
+                    break;
+                case sf::Keyboard::F4:
+                    gpuEnabled = !gpuEnabled;
                     needsRedraw = true;
                     break;
-                    state.colorDensity /= 1.2f;
+                case sf::Keyboard::F5:
+                    state.histogramColoring = !state.histogramColoring;
+                    needsRecolor = true;
+                    break;
+                case sf::Keyboard::F6:
+                    // Off -> path -> mouse -> off.
+                    seedAnimation = static_cast<SeedAnimation>((static_cast<int>(seedAnimation) + 1) % 3);
+                    if (seedAnimation == SeedAnimation::Path) {
+                        seedAnimationStart = std::chrono::steady_clock::now();
+                    }
+                    if (seedAnimation != SeedAnimation::Off) {
+                        state.showJulia = true;
+                    }
+                    needsRedraw = true;
+                    break;
+                case sf::Keyboard::F:
+                    // Off -> interior -> bands -> off.
+                    state.solidFill = static_cast<SolidFill>((static_cast<int>(state.solidFill) + 1) % 3);
                     needsRedraw = true;
                     break;
+                case sf::Keyboard::Add:
+                    state.colorDensity *= 1.2f;
+                    needsRecolor = true;
+                    break;
+                case sf::Keyboard::Subtract:
+                    state.colorDensity /= 1.2f;
+                    needsRecolor = true;
+                    break;
+                case sf::Keyboard::D:
                     outputStateDetails(state);
                     break;
+                case sf::Keyboard::LBracket:
                     if (state.stripes) {
                         state.stripeFrequency = std::max(1.0f, state.stripeFrequency - 1.0f);
                         needsRedraw = true;
                     }
                     break;
+                case sf::Keyboard::RBracket:
                     if (state.stripes) {
                         state.stripeFrequency += 1.0f;
                         needsRedraw = true;
                     }
                     break;
+                default:
+                    break;
                 }
             }
         }
 
-        if (viewChanged && scrollTimer.getElapsedTime().asSeconds() > SCROLL_RENDER_DELAY) {
-            pendingHighQualityRender = true;
-            viewChanged = false;
+        // Leaving the Julia set stops the animation as well.
+        if (seedAnimation != SeedAnimation::Off && !state.showJulia) {
+            seedAnimation = SeedAnimation::Off;
+        }
+        if (seedAnimation == SeedAnimation::Off && showingAnimation) {
+            animator.cancel();
+            showingAnimation = false;
+            needsRedraw = true;
+        }
+
+        if (seedAnimation != SeedAnimation::Off) {
+            if (seedAnimation == SeedAnimation::Path) {
+                double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                    seedAnimationStart).count();
+                double angle = 2 * std::acos(-1.0) * seconds / JULIA_PATH_SECONDS;
+                state.juliaX = JULIA_PATH_RADIUS * std::cos(angle);
+                state.juliaY = JULIA_PATH_RADIUS * std::sin(angle);
+            }
+            else {
+                state.juliaX = mouseComplexX;
+                state.juliaY = mouseComplexY;
+            }
+
+            if (!showingAnimation) {
+                renderer.cancel();
+                showingAnimation = true;
+            }
+            // The next frame goes to the pool before the finished one is
+            // uploaded, so the upload overlaps its iterations.
+            bool finished = animator.finish();
+            if (finished) {
+                renderTimeStr.clear();
+                appendFormatted(renderTimeStr, "Seed animation: %.1fms at %dx%d, %.2f Giter/s", animator.getFrameTime(),
+                    animator.getFrameWidth(), animator.getFrameHeight(), animator.getBudget().getIterationRate());
+                writeBusyTimeString(busyTimeStr, renderPool, busyTimes);
+                writeCounterString(counterStr, animator.getCounters());
+            }
+            if (!animator.isBusy()) {
+                animator.start(state, windowWidth, windowHeight);
+            }
+            if (finished) {
+                animator.present(animationTexture, animationSprite, windowWidth, windowHeight);
+            }
+        }
+        else if (needsRedraw || needsRecolor) {
+            RenderBackend* chosen = &cpuBackend;
+            if (gpuEnabled && gpuRenderer.supports(state)) chosen = &gpuRenderer;
+            RenderMode mode = needsRedraw ? (onlyDragged ? RenderMode::Full : RenderMode::Progressive) :
+                RenderMode::Recolor;
+            // A backend missed the views the other one drew, so switching is
+            // a redraw even for a recolor.
+            if (chosen != backend) {
+                backend->cancel();
+                mode = RenderMode::Progressive;
+            }
+            backend = chosen;
+            backend->start(state, mode);
         }
 
-        if (pendingHighQualityRender) {
-            startTime = std::chrono::high_resolution_clock::now();
-            renderFractal(pixels, state, WINDOW_WIDTH, WINDOW_HEIGHT, false);
-            endTime = std::chrono::high_resolution_clock::now();
-            duration = std::chrono::duration_cast<std::chrono::milliseconds>(endTime - startTime).count();
-            renderTimeStr = "Render time: " + std::to_string(duration) + "ms";
-            texture.update(pixels);
-            pendingHighQualityRender = false;
+        bool presented = backend->present();
+        if (presented && backend == &gpuRenderer) {
+            renderTimeStr.assign("Render: GPU shader");
+            busyTimeStr.clear();
+            counterStr.clear();
         }
-        else if (needsRedraw) {
-            startTime = std::chrono::high_resolution_clock::now();
-            renderFractal(pixels, state, WINDOW_WIDTH, WINDOW_HEIGHT, usePreview);
-            endTime = std::chrono::high_resolution_clock::now();
-            duration = std::chrono::duration_cast<std::chrono::milliseconds>(endTime - startTime).count();
-            renderTimeStr = usePreview ? "Preview time: " + std::to_string(duration) + "ms"
-                : "Render time: " + std::to_string(duration) + "ms";
-            texture.update(pixels);
+        else if (presented) {
+            duration = renderer.getRenderTime();
+            renderTimeStr.clear();
+            switch (renderer.getMode()) {
+            case RenderMode::Progressive:
+                appendFormatted(renderTimeStr, "Render time: %lldms (first pass %lldms at 1/%d, %.2f Giter/s)", duration,
+                    renderer.getFirstPassTime(), renderer.getFirstDownscale(), renderer.getBudget().getIterationRate());
+                break;
+            case RenderMode::Recolor:
+                appendFormatted(renderTimeStr, "Recolor time: %lldms", duration);
+                break;
+            default:
+                appendFormatted(renderTimeStr, "Render time: %lldms", duration);
+                break;
+            }
+            writeBusyTimeString(busyTimeStr, renderPool, busyTimes);
+            writeCounterString(counterStr, renderer.getCounters());
+            heatmap.update(renderer, windowWidth, windowHeight);
+            statsChanged = true;
         }
 
+        // The stats describe the last CPU job.
+        bool showingGpu = backend == &gpuRenderer;
+        bool showingJob = !showingGpu && !showingAnimation;
         if (hasFontLoaded) {
-            infoText.setString(getInfoString(state, mouseComplexX, mouseComplexY));
-            performanceText.setString(renderTimeStr);
+            writeInfoString(infoString, state, windowHeight);
+            if (infoString != shownInfoString) {
+                infoText.setString(infoString);
+                shownInfoString.swap(infoString);
+            }
+            performanceString.clear();
+            performanceString.append(renderTimeStr).append("   ").append(busyTimeStr).append("   ").append(counterStr);
+            if (performanceString != shownPerformanceString) {
+                performanceText.setString(performanceString);
+                shownPerformanceString.swap(performanceString);
+            }
         }
+        bool showStats = hasFontLoaded && showRenderStats && showingJob;
+        if (showStats && (statsChanged || !statsShown)) {
+            statsText.setString(getRenderStatsString(renderer));
+            sf::FloatRect bounds = statsText.getLocalBounds();
+            statsText.setPosition(10, windowHeight - 40 - bounds.height);
+            statsBg.setSize(sf::Vector2f(bounds.width + 10, bounds.height + 10));
+            statsBg.setPosition(5, windowHeight - 40 - bounds.height);
+            statsChanged = false;
+        }
+        statsShown = showStats;
 
         window.clear();
-        window.draw(sprite);
+        window.draw(showingAnimation ? animationSprite : showingGpu ? gpuSprite : sprite);
+        if (showRenderStats && showingJob) window.draw(heatmap.getSprite());
 
         if (hasFontLoaded) {
-            sf::RectangleShape textBg(sf::Vector2f(350, 180));
-            textBg.setFillColor(sf::Color(0, 0, 0, 180));
-            textBg.setPosition(5, 5);
             window.draw(textBg);
-
             window.draw(infoText);
             window.draw(performanceText);
+
+            if (showStats) {
+                window.draw(statsBg);
+                window.draw(statsText);
+            }
         }
 
         window.display();
     }
 
-    delete[] pixels;
+    animator.cancel();
+    renderer.cancel();
 
     return 0;
 }